@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/mman.h>
+
+#include "arena.h"
+
+/* Map size bytes, a multiple of arenaPageSize, from the hugetlb pool. */
+static void *
+mapHugeTLB([[maybe_unused]] size_t size)
+{
+#ifdef MAP_HUGETLB
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+#ifdef MAP_HUGE_SHIFT
+	/* arenaPageSize, whatever the default huge page size is */
+	flags |= 21 << MAP_HUGE_SHIFT;
+#endif
+	/*
+	 * Without MAP_NORESERVE the pages are reserved now, so this fails
+	 * cleanly if the pool is too small rather than faulting later.
+	 */
+	return mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+#else
+	return MAP_FAILED;
+#endif
+}
+
+/* Map size bytes of ordinary memory, aligned to arenaPageSize. */
+static void *
+mapAligned(size_t size)
+{
+	size_t mapped = size + arenaPageSize;
+	void *p = mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+		       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (p == MAP_FAILED) {
+		return p;
+	}
+
+	/* Trim the slack on either side of the aligned part */
+	uintptr_t start = (uintptr_t)p;
+	uintptr_t base = (start + arenaPageSize - 1) & ~(arenaPageSize - 1);
+	if (base != start) {
+		munmap(p, base - start);
+	}
+	if (base + size != start + mapped) {
+		munmap((void *)(base + size), start + mapped - (base + size));
+	}
+#ifdef MADV_HUGEPAGE
+	/* Ask for transparent huge pages as the pages get touched. */
+	madvise((void *)base, size, MADV_HUGEPAGE);
+#endif
+	return (void *)base;
+}
+
+bool
+arenaCreate(Arena &arena, size_t size)
+{
+	size = (size + arenaPageSize - 1) & ~(arenaPageSize - 1);
+
+	void *p = mapHugeTLB(size);
+	if (p == MAP_FAILED) {
+		p = mapAligned(size);
+	}
+	if (p == MAP_FAILED) {
+		return false;
+	}
+
+	arena.base = (uint8_t *)p;
+	arena.size = size;
+	arena.used = 0;
+	return true;
+}
+
+void *
+arenaAlloc(Arena &arena, size_t size, size_t align)
+{
+	size_t offset = (arena.used + align - 1) & ~(align - 1);
+
+	if (offset > arena.size || arena.size - offset < size) {
+		return nullptr;
+	}
+	arena.used = offset + size;
+	return arena.base + offset;
+}
+
+void
+arenaRelease(void *p, size_t size)
+{
+	madvise(p, size, MADV_DONTNEED);
+}
+
+void
+arenaDestroy(Arena &arena)
+{
+	if (arena.base) {
+		munmap(arena.base, arena.size);
+	}
+	arena.base = nullptr;
+	arena.size = 0;
+	arena.used = 0;
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/* Arenas are mapped in, and can release, whole huge pages. */
+static const size_t arenaPageSize = 2 << 20;
+
+/*
+ * One contiguous mapping that an emulator instance carves all of its
+ * memory from, so the host can back it with huge pages and tearing the
+ * instance down is a single unmap.
+ *
+ * The mapping is anonymous and therefore zero filled, and its base is
+ * aligned to arenaPageSize. It comes from the MAP_HUGETLB pool if the
+ * administrator reserved one large enough for the whole arena; pool
+ * pages are set aside already, so taking them up front costs no other
+ * memory. Otherwise it is ordinary memory that transparent huge page
+ * support backs with huge pages as it is touched, and pages the guest
+ * never touches are never committed. Allocations are bump allocated and
+ * only released all at once.
+ */
+struct Arena {
+	uint8_t *base;
+	size_t size;
+	size_t used;
+};
+
+/* Map an arena of at least size bytes. Returns false if mapping fails. */
+extern bool
+arenaCreate(Arena &arena, size_t size);
+
+/*
+ * Carve size zeroed bytes aligned to align (a power of two) from arena.
+ * Returns null if the arena is exhausted.
+ */
+extern void *
+arenaAlloc(Arena &arena, size_t size, size_t align = 64);
+
+/*
+ * Return size bytes at p, both multiples of arenaPageSize from the start
+ * of an arena, to the host. They read back as zero.
+ */
+extern void
+arenaRelease(void *p, size_t size);
+
+/* Unmap the whole arena. Everything allocated from it is gone. */
+extern void
+arenaDestroy(Arena &arena);
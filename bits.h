@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+/*
+ * Bitfield helpers for instruction decoding. Field positions are
+ * template arguments, so each use folds to a shift and mask (or a
+ * single movsx/sar pair for sign extension) in the interpreter.
+ */
+
+/* Bits [Lo, Lo + Width) of v, shifted down to bit 0. */
+template <unsigned Lo, unsigned Width, class T>
+static constexpr T
+bitField(T v)
+{
+	static_assert(std::is_unsigned_v<T>, "fields are extracted unsigned");
+	static_assert(Width > 0 && Lo + Width <= sizeof(T) * 8,
+		      "field does not fit the type");
+
+	if constexpr (Width == sizeof(T) * 8) {
+		return v;
+	} else {
+		return (T)(v >> Lo) & (((T)1 << Width) - 1);
+	}
+}
+
+/* The low Width bits of v as a two's complement number. */
+template <unsigned Width, class T>
+static constexpr int64_t
+signExtend(T v)
+{
+	static_assert(std::is_unsigned_v<T>, "sign-extend unsigned values");
+	static_assert(Width > 0 && Width <= sizeof(T) * 8,
+		      "field does not fit the type");
+
+	return (int64_t)((uint64_t)v << (64 - Width)) >> (64 - Width);
+}
+
+/* Bits [Lo, Lo + Width) of v, sign-extended. */
+template <unsigned Lo, unsigned Width, class T>
+static constexpr int64_t
+signedField(T v)
+{
+	return signExtend<Width>(bitField<Lo, Width>(v));
+}
+
+static_assert(bitField<21, 5>(0x03e00000u) == 31);
+static_assert(bitField<26, 6>(0xfc000000u) == 63);
+static_assert(bitField<0, 26>(0xffffffffu) == 0x03ffffff);
+static_assert(bitField<0, 32>(0x89abcdefu) == 0x89abcdef);
+static_assert(bitField<60, 4>(0xf000000000000000ull) == 15);
+static_assert(signExtend<8>((uint8_t)0x80) == -128);
+static_assert(signExtend<8>((uint8_t)0x7f) == 127);
+static_assert(signExtend<16>(0x12348000u) == -32768);
+static_assert(signExtend<16>(0xffff7fffu) == 32767);
+static_assert(signExtend<32>(0x80000000u) == INT32_MIN);
+static_assert(signExtend<32>(0xffffffff7fffffffull) == INT32_MAX);
+static_assert(signExtend<64>(0xffffffffffffffffull) == -1);
+static_assert(signExtend<1>(1u) == -1 && signExtend<1>(2u) == 0);
+static_assert(signedField<0, 7>(0x40u) == -64);
+static_assert(signedField<7, 4>(0x780u) == -1);
+
+/* The exhaustive sweeps live in cpu.cpp, to be evaluated only once. */
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bus.h"
+#include "mi.h"
+#include "pif.h"
+#include "rcp.h"
+#include "vi.h"
+
+static inline uint32_t
+load32(const uint8_t *p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+	       (uint32_t)p[2] << 8 | p[3];
+}
+
+static inline void
+store32(uint8_t *p, uint32_t value)
+{
+	p[0] = (uint8_t)(value >> 24);
+	p[1] = (uint8_t)(value >> 16);
+	p[2] = (uint8_t)(value >> 8);
+	p[3] = (uint8_t)value;
+}
+
+uint32_t
+mmioRead32(uint32_t paddr)
+{
+	paddr &= ~3;
+	switch (paddr) {
+	case 0x04000000 ... 0x04000fff: /* SP DMEM */
+		return load32(&sp->dmem[paddr & 0xfff]);
+	case 0x04001000 ... 0x04001fff: /* SP IMEM */
+		return load32(&sp->imem[paddr & 0xfff]);
+	case 0x04300000 ... 0x043fffff: /* MI */
+		return miRead(paddr & 0xff);
+	case 0x04400000 ... 0x044fffff: /* VI */
+		return viRead(paddr & 0xff);
+	case 0x04800000 ... 0x048fffff: /* SI */
+		return siRead(paddr & 0xff);
+	case 0x1fc007c0 ... 0x1fc007ff: /* PIF RAM */
+		return pifRead32(paddr & 0x3f);
+	default:
+		return 0;
+	}
+}
+
+void
+mmioWrite32(uint32_t paddr, uint32_t value)
+{
+	paddr &= ~3;
+	switch (paddr) {
+	case 0x04000000 ... 0x04000fff: /* SP DMEM */
+		store32(&sp->dmem[paddr & 0xfff], value);
+		break;
+	case 0x04001000 ... 0x04001fff: /* SP IMEM */
+		store32(&sp->imem[paddr & 0xfff], value);
+		break;
+	case 0x04300000 ... 0x043fffff: /* MI */
+		miWrite(paddr & 0xff, value);
+		break;
+	case 0x04400000 ... 0x044fffff: /* VI */
+		viWrite(paddr & 0xff, value);
+		break;
+	case 0x04800000 ... 0x048fffff: /* SI */
+		siWrite(paddr & 0xff, value);
+		break;
+	case 0x1fc007c0 ... 0x1fc007ff: /* PIF RAM */
+		pifWrite32(paddr & 0x3f, value);
+		break;
+	}
+}
+
+uint8_t
+mmioRead8(uint32_t paddr)
+{
+	return (uint8_t)(mmioRead32(paddr & ~3) >> (24 - 8 * (paddr & 3)));
+}
+
+void
+mmioWrite8(uint32_t paddr, uint8_t value)
+{
+	switch (paddr) {
+	case 0x04000000 ... 0x04000fff: /* SP DMEM */
+		sp->dmem[paddr & 0xfff] = value;
+		break;
+	case 0x04001000 ... 0x04001fff: /* SP IMEM */
+		sp->imem[paddr & 0xfff] = value;
+		break;
+	case 0x1fc007c0 ... 0x1fc007ff: /* PIF RAM */
+		pif->ram[paddr & 0x3f] = value;
+		break;
+	default:
+		mmioWrite32(paddr & ~3, (uint32_t)value << (24 - 8 * (paddr & 3)));
+		break;
+	}
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "mem.h"
+
+/*
+ * The CPU's view of the physical address space. RDRAM is checked first
+ * and handled inline; everything else (RSP memory, RCP registers, PIF)
+ * goes through an out-of-line decoder. RCP registers are 32 bits wide,
+ * so narrower accesses to them are widened.
+ */
+
+extern uint32_t
+mmioRead32(uint32_t paddr);
+
+extern void
+mmioWrite32(uint32_t paddr, uint32_t value);
+
+extern uint8_t
+mmioRead8(uint32_t paddr);
+
+extern void
+mmioWrite8(uint32_t paddr, uint8_t value);
+
+static inline bool
+isRDRAM(uint32_t paddr)
+{
+	return paddr < rdramSize;
+}
+
+static inline uint8_t
+busRead8(uint32_t paddr)
+{
+	return isRDRAM(paddr) ? rdramRead8(paddr) : mmioRead8(paddr);
+}
+
+static inline uint16_t
+busRead16(uint32_t paddr)
+{
+	if (isRDRAM(paddr)) {
+		return rdramRead16(paddr);
+	}
+	return (uint16_t)(mmioRead32(paddr & ~3) >> (16 - 8 * (paddr & 2)));
+}
+
+static inline uint32_t
+busRead32(uint32_t paddr)
+{
+	return isRDRAM(paddr) ? rdramRead32(paddr) : mmioRead32(paddr);
+}
+
+static inline uint64_t
+busRead64(uint32_t paddr)
+{
+	if (isRDRAM(paddr)) {
+		return rdramRead64(paddr);
+	}
+	return (uint64_t)mmioRead32(paddr) << 32 | mmioRead32(paddr + 4);
+}
+
+static inline void
+busWrite8(uint32_t paddr, uint8_t value)
+{
+	if (isRDRAM(paddr)) {
+		rdramWrite8(paddr, value);
+	} else {
+		mmioWrite8(paddr, value);
+	}
+}
+
+static inline void
+busWrite16(uint32_t paddr, uint16_t value)
+{
+	if (isRDRAM(paddr)) {
+		rdramWrite16(paddr, value);
+	} else {
+		mmioWrite32(paddr & ~3, (uint32_t)value << (16 - 8 * (paddr & 2)));
+	}
+}
+
+static inline void
+busWrite32(uint32_t paddr, uint32_t value)
+{
+	if (isRDRAM(paddr)) {
+		rdramWrite32(paddr, value);
+	} else {
+		mmioWrite32(paddr, value);
+	}
+}
+
+static inline void
+busWrite64(uint32_t paddr, uint64_t value)
+{
+	if (isRDRAM(paddr)) {
+		rdramWrite64(paddr, value);
+	} else {
+		mmioWrite32(paddr, (uint32_t)(value >> 32));
+		mmioWrite32(paddr + 4, (uint32_t)value);
+	}
+}
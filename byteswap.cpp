@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "byteswap.h"
+
+typedef void (*Swapper)(uint8_t *d, const uint8_t *s, const uint8_t *end,
+			bool inPlace);
+
+/* The tail, or everything on hosts without a vector kernel */
+static void
+swapWords(uint8_t *d, const uint8_t *s, const uint8_t *end, bool inPlace)
+{
+	for (; s < end; s += 4, d += 4) {
+		uint32_t v;
+		memcpy(&v, s, sizeof(v));
+		if (inPlace && !v) {
+			continue;
+		}
+		v = __builtin_bswap32(v);
+		memcpy(d, &v, sizeof(v));
+	}
+}
+
+#if defined(__SSE2__)
+__attribute__((target("ssse3"))) static void
+swapSSSE3(uint8_t *d, const uint8_t *s, const uint8_t *end, bool inPlace)
+{
+	const __m128i order = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9,
+					    8, 15, 14, 13, 12);
+	for (; end - s >= 16; s += 16, d += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)s);
+		if (inPlace && _mm_movemask_epi8(_mm_cmpeq_epi8(
+				       v, _mm_setzero_si128())) == 0xffff) {
+			continue;
+		}
+		_mm_storeu_si128((__m128i *)d, _mm_shuffle_epi8(v, order));
+	}
+	swapWords(d, s, end, inPlace);
+}
+
+__attribute__((target("avx2"))) static void
+swapAVX2(uint8_t *d, const uint8_t *s, const uint8_t *end, bool inPlace)
+{
+	const __m256i order = _mm256_setr_epi8(
+		3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+		3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	for (; end - s >= 32; s += 32, d += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)s);
+		if (inPlace && _mm256_testz_si256(v, v)) {
+			continue;
+		}
+		_mm256_storeu_si256((__m256i *)d, _mm256_shuffle_epi8(v, order));
+	}
+	swapWords(d, s, end, inPlace);
+}
+#endif
+
+/* The widest kernel the host CPU runs, picked once at startup. */
+static Swapper
+pickSwapper()
+{
+#if defined(__SSE2__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		return swapAVX2;
+	}
+	if (__builtin_cpu_supports("ssse3")) {
+		return swapSSSE3;
+	}
+#endif
+	return swapWords;
+}
+
+static const Swapper swapper = pickSwapper();
+
+void
+swap32(void *dst, const void *src, size_t size)
+{
+	const uint8_t *s = (const uint8_t *)src;
+	swapper((uint8_t *)dst, s, s + size, dst == src);
+}
@@ -24,599 +24,502 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include <climits>
-#include <cstdlib>
-#include <iostream>
-#include <string>
+#include <cstring>
 
+#include "bits.h"
+#include "bus.h"
 #include "cpu.h"
-#include "mem.h"
+#include "debugger.h"
+#include "emulator.h"
+#include "frameskip.h"
+#include "idle.h"
+#include "mi.h"
+#include "mips.h"
+#include "rcp.h"
+#include "scheduler.h"
+#include "timeline.h"
+#include "timers.h"
 
-static int branchNext = -1;
+/*
+ * Exhaustive checks against the casts these helpers replaced: every 8-
+ * and 16-bit pattern, with junk above the field, and a pseudo-random
+ * sample of 32-bit ones. They take a while to evaluate, so they are here
+ * rather than in bits.h, and the 16-bit sweep is split so each call stays
+ * under the compilers' constant evaluation step limits.
+ */
+static constexpr bool
+bitsMatchCasts16(uint32_t lo, uint32_t hi)
+{
+	for (uint32_t v = lo; v < hi; v++) {
+		uint32_t junk = v | 0xa5a50000u;
+		if (signExtend<16>((uint16_t)v) != (int16_t)v ||
+		    signExtend<16>(junk) != (int16_t)v ||
+		    signExtend<8>((uint8_t)v) != (int8_t)v ||
+		    signExtend<8>(junk) != (int8_t)v ||
+		    bitField<0, 16>(junk) != v ||
+		    bitField<8, 8>(junk) != (uint8_t)(v >> 8) ||
+		    signedField<8, 8>(junk) != (int8_t)(v >> 8)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static constexpr bool
+bitsMatchCasts32(uint32_t seed, unsigned count)
+{
+	uint32_t v = seed;
+	for (unsigned i = 0; i < count; i++) {
+		v = v * 1664525u + 1013904223u;
+		uint64_t junk = v | 0x5a5a5a5a00000000ull;
+		if (signExtend<32>(v) != (int32_t)v ||
+		    signExtend<32>(junk) != (int32_t)v ||
+		    signExtend<16>(v) != (int16_t)v ||
+		    bitField<16, 16>(v) != v >> 16 ||
+		    signedField<16, 16>(v) != (int16_t)(v >> 16) ||
+		    bitField<0, 32>(junk) != v) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static_assert(bitsMatchCasts16(0x0000, 0x4000));
+static_assert(bitsMatchCasts16(0x4000, 0x8000));
+static_assert(bitsMatchCasts16(0x8000, 0xc000));
+static_assert(bitsMatchCasts16(0xc000, 0x10000));
+static_assert(bitsMatchCasts32(1, 4096));
+
+/* The VR4300 side of the shared core in mips.h. */
+struct VR4300 {
+	static const uint64_t pcMask = ~0ull;
+	static const bool mips3 = true;
+	static const bool hasFPU = true;
+	static const bool hasCOP0Ops = true;
+	static const TraceCore traceCore = TraceVR4300;
+
+	static ExecState &
+	exec();
+
+	static Registers &
+	regs()
+	{
+		return *reg;
+	}
+
+	/* KSEG0/KSEG1 only until there is a TLB */
+	static uint8_t
+	read8(uint64_t vaddr)
+	{
+		return busRead8(vaddr & 0x1fffffff);
+	}
+
+	static uint16_t
+	read16(uint64_t vaddr)
+	{
+		return busRead16(vaddr & 0x1fffffff);
+	}
+
+	static uint32_t
+	read32(uint64_t vaddr)
+	{
+		return busRead32(vaddr & 0x1fffffff);
+	}
+
+	static uint64_t
+	read64(uint64_t vaddr)
+	{
+		return busRead64(vaddr & 0x1fffffff);
+	}
+
+	static void
+	write8(uint64_t vaddr, uint8_t value)
+	{
+		busWrite8(vaddr & 0x1fffffff, value);
+	}
+
+	static void
+	write16(uint64_t vaddr, uint16_t value)
+	{
+		busWrite16(vaddr & 0x1fffffff, value);
+	}
+
+	static void
+	write32(uint64_t vaddr, uint32_t value)
+	{
+		busWrite32(vaddr & 0x1fffffff, value);
+	}
+
+	static void
+	write64(uint64_t vaddr, uint64_t value)
+	{
+		busWrite64(vaddr & 0x1fffffff, value);
+	}
+
+	static uint64_t
+	readCOP0(int rd);
+
+	static void
+	writeCOP0(int rd, uint64_t value);
+
+	static void
+	exception(ExceptionCode code)
+	{
+		cpuException(code);
+	}
+
+	static void
+	eret();
+
+	static void
+	watch(uint64_t vaddr, int size, bool write)
+	{
+		uint32_t paddr = vaddr & 0x1fffffff;
+		if (paddr >= rdramSize) {
+			return;
+		}
+
+		uint32_t page = paddr >> rdramPageShift;
+		uint8_t consumers = emu->vr4300.watchPages[page];
+		if (consumers & WatchDebugger) {
+			debugWatchAccess(paddr, size, write);
+		}
+		if ((consumers & WatchReadback) && !write) {
+			frameskipReadback(paddr);
+		}
+	}
+
+	template <class P>
+	static const Decoded &
+	fetch(uint64_t pc);
+};
+
+ExecState &
+VR4300::exec()
+{
+	return emu->vr4300.exec;
+}
+
+static void
+flushPage(uint32_t page)
+{
+	VR4300State &s = emu->vr4300;
+
+	if (s.decodedUsed[page]) {
+		memset(&s.decoded[page * decodedPerPage], 0,
+		       decodedPerPage * sizeof(Decoded));
+		s.decodedUsed[page] = false;
+	}
+}
+
+static void
+flushDecoded()
+{
+	for (uint32_t page = 0; page < rdramPages; page++) {
+		flushPage(page);
+	}
+}
+
+template <class P>
+const Decoded &
+VR4300::fetch(uint64_t pc)
+{
+	uint32_t paddr = pc & 0x1fffffff;
+
+	if (paddr >= rdramSize) {
+		/* Boot ROM and SP memory are not cached */
+		static thread_local Decoded uncached;
+		uncached = decode<VR4300, P>(busRead32(paddr));
+		if (!emu->debug.breakpoints.empty()) {
+			debugPatch(uncached, paddr);
+		}
+		return uncached;
+	}
+
+	uint32_t page = paddr >> rdramPageShift;
+	/*
+	 * A write to the page sets its DirtyDecode bit, which makes the next
+	 * fetch from it start over.
+	 */
+	if (mem->dirty[page] & DirtyDecode) {
+		flushPage(page);
+		mem->dirty[page] &= ~DirtyDecode;
+	}
+
+	Decoded &d = emu->vr4300.decoded[paddr >> 2];
+	if (!d.handler) {
+		d = decode<VR4300, P>(rdramRead32(paddr));
+		emu->vr4300.decodedUsed[page] = true;
+		if (emu->debug.breakPages[page]) {
+			debugPatch(d, paddr);
+		}
+	}
+	return d;
+}
+
+uint32_t
+cpuReadCount()
+{
+	return (uint32_t)(sched->cycles / 2 + reg->cop0[COP0Count]);
+}
+
+static void
+scheduleCompare()
+{
+	uint32_t delta = (uint32_t)reg->cop0[COP0Compare] - cpuReadCount();
+	uint64_t ticks = delta ? delta : 1ull << 32;
+	schedule(EventCompare, (sched->cycles / 2 + ticks) * 2);
+}
 
 void
-execCPU(uint32_t opcode, int context, bool parseOnly)
+cpuWriteCount(uint32_t value)
 {
-	uint8_t op = (opcode & 0b11111100000000000000000000000000) >> 26;
-	/* I-Type (Immediate) variables */
-	uint16_t immediate = opcode & 0b00000000000000001111111111111111;
-	/* J-Type (Jump) variables */
-	uint32_t target = opcode & 0b00000011111111111111111111111111;
-	/* R-Type (Register) variables (rs, rt used in I Type as well) */
-	uint8_t rs = opcode & 0b00000011111000000000000000000000 >> 21;
-	uint8_t rt = opcode & 0b00000000000111110000000000000000 >> 16;
-	uint8_t rd = opcode & 0b00000000000000001111100000000000 >> 11;
-	uint8_t sa = opcode & 0b00000000000000000000011111000000 >> 6;
-	uint8_t funct = opcode & 0b00000000000000000000000000111111;
-	if (!parseOnly) {
-		switch (op) {
-		case 0b00000000:
-			if (sa == 0b00000000) {
-				switch (funct) {
-				case 0b00100000: /* ADD */
-					if (reg.gpr[rs] <
-					    INT_MAX - reg.gpr[rt]) {
-						/* Add integer overflow code! */
-					}
-					reg.gpr[rd] = ((signed)reg.gpr[rs] +
-						       (signed)reg.gpr[rt]);
-					break;
-				case 0b00100001: /* ADDU */
-					reg.gpr[rd] =
-						(reg.gpr[rs] + reg.gpr[rt]);
-					break;
-				case 0b00100100: /* AND */
-					reg.gpr[rd] =
-						(reg.gpr[rs] & reg.gpr[rt]);
-					break;
-				case 0b00101100: /* DADD */
-					/*
-					 * Note: Should only run in 64
-					 * bit mode or 32 bit kernel
-					 * mode. Otherwise throw
-					 * reserved instruction
-					 * exception.
-					 */
-					if (reg.gpr[rs] <
-					    INT_MAX - reg.gpr[rt]) {
-						/* Add integer overflow code! */
-					} else {
-						reg.gpr[rd] = ((signed)reg.gpr[rs] +
-							       (signed)reg.gpr[rt]);
-					}
-					break;
-				case 0b00101101: /* DADDU */
-					/*
-					 * Note: Should only run in 64
-					 * bit mode or 32 bit kernel
-					 * mode. Otherwise throw
-					 * reserved instruction
-					 * exception.
-					 */
-					reg.gpr[rd] = ((signed)reg.gpr[rs] +
-						       (signed)reg.gpr[rt]);
-					break;
-				}
-			} else {
-				switch (funct) {
-				case 0b00001101: /* BREAK */
-					/* TODO */
-					break;
-				}
-			}
-		case 0b00001000: /* ADDI */
-			if (reg.gpr[rs] <
-			    INT_MAX - reg.gpr[signExtend(immediate)]) {
-				/* Add integer overflow code! */
-			}
-			reg.gpr[rt] = ((signed)reg.gpr[rs] +
-				       (signed)signExtend(immediate));
-			break;
-		case 0b00001001: /* ADDIU */
-			reg.gpr[rt] = (reg.gpr[rs] + signExtend(immediate));
-			break;
-		case 0b00001100: /* ANDI */
-			reg.gpr[rt] = (reg.gpr[rs] & immediate);
-			break;
-		case 0b00010000:
-			if ((sa == 0) && (funct == 0)) {
-				switch (rs) {
-				case 0b00000010: /* CFC0 */
-					/* TODO */
-					break;
-				}
-			} else {
-				switch (rs) {
-				case 0b00001000:
-					switch (rt) {
-					case 0b00000000: /* BC0F */
-						/* TODO */
-						break;
-					case 0b00000010: /* BC0FL */
-						/* TODO */
-						break;
-					case 0b00000001: /* BC0T */
-						/* TODO */
-						break;
-					case 0b00000011: /* BC0TL */
-						/* TODO */
-						break;
-					}
-					break;
-				case 0b00010000: /* COP0 */
-					/* TODO */
-					break;
-				case 0b0000110:
-					if (opcode &
-					    0b00000000000000000000011111111111) { /* CTC0 */
-						/* TODO */
-					}
-					break;
-				}
-			}
-			break;
-		case 0b00010001:
-			if ((sa == 0) && (funct == 0)) {
-				switch (rs) {
-				case 0b00000010: /* CFC1 */
-					/* TODO */
-					break;
-				}
-			} else {
-				switch (rs) {
-				case 0b00001000:
-					switch (rt) {
-					case 0b00000000: /* BC1F */
-						/* TODO */
-						break;
-					case 0b00000010: /* BC1FL */
-						/* TODO */
-						break;
-					case 0b00000001: /* BC1T */
-						/* TODO */
-						break;
-					case 0b00000011: /* BC1TL */
-						/* TODO */
-						break;
-					}
-					break;
-				case 0b00010000: /* COP1 */
-					/* TODO */
-					break;
-				case 0b0000110:
-					if (opcode &
-					    0b00000000000000000000011111111111) { /* CTC1 */
-						/* TODO */
-					}
-					break;
-				}
-			}
-			break;
-		case 0b00010010:
-			if ((sa == 0) && (funct == 0)) {
-				switch (rs) {
-				case 0b00000010: /* CFC2 */
-					/* TODO */
-					break;
-				}
-			} else {
-				switch (rs) {
-				case 0b00001000:
-					switch (rt) {
-					case 0b00000000: /* BC2F */
-						/* TODO */
-						break;
-					case 0b00000010: /* BC2FL */
-						/* TODO */
-						break;
-					case 0b00000001: /* BC2T */
-						/* TODO */
-						break;
-					case 0b00000011: /* BC2TL */
-						/* TODO */
-						break;
-					}
-					break;
-				case 0b00010000: /* COP2 */
-					/* TODO */
-					break;
-				case 0b0000110:
-					if (opcode &
-					    0b00000000000000000000011111111111) { /* CTC2 */
-						/* TODO */
-					}
-					break;
-				}
-			}
-			break;
-		case 0b00010011:
-			if ((sa == 0) && (funct == 0)) {
-				switch (rs) {
-				case 0b00000010: /* CFC3 */
-					/* TODO */
-					break;
-				}
-			} else {
-				switch (rs) {
-				case 0b00001000:
-					switch (rt) {
-					case 0b00000000: /* BC3F */
-						/* TODO */
-						break;
-					case 0b00000010: /* BC3FL */
-						/* TODO */
-						break;
-					case 0b00000001: /* BC3T */
-						/* TODO */
-						break;
-					case 0b00000011: /* BC3TL */
-						/* TODO */
-						break;
-					}
-					break;
-				case 0b00010000: /* COP3 */
-					/* TODO */
-					break;
-				case 0b0000110:
-					if (opcode &
-					    0b00000000000000000000011111111111) { /* CTC3 */
-						/* TODO */
-					}
-					break;
-				}
-			}
-			break;
-		case 0b00000100: /* BEQ */
-			if (reg.gpr[rs] == reg.gpr[rt]) {
-				branchNext = mem.mem[reg.pc + 1] +
-					     (signExtend(immediate) << 2);
-			}
-			break;
-		case 0b00010100: /* BEQL */
-			if (reg.gpr[rs] == reg.gpr[rt]) {
-				branchNext = mem.mem[reg.pc + 1] +
-					     (signExtend(immediate) << 2);
-			} else {
-				reg.pc++;
-			}
-			break;
-		case 0b00000001:
-			switch (rt) {
-			case 0b00000001: /* BGEZ */
-				if (reg.gpr[rs] >= 0) {
-					branchNext =
-						mem.mem[reg.pc + 1] +
-						(signExtend(immediate) << 2);
-				}
-				break;
-			case 0b00010001: /* BGEZAL */
-				reg.gpr[31] = mem.mem[reg.pc + 1];
-				if (reg.gpr[rs] >= 0) {
-					branchNext =
-						mem.mem[reg.pc + 1] +
-						(signExtend(immediate) << 2);
-				}
-				break;
-			case 0b00010011: /* BGEZALL */
-				reg.gpr[31] = mem.mem[reg.pc + 1];
-				if (reg.gpr[rs] >= 0) {
-					branchNext =
-						mem.mem[reg.pc + 1] +
-						(signExtend(immediate) << 2);
-				} else {
-					reg.pc++;
-				}
-				break;
-			case 0b00000011: /* BGEZL */
-				if (reg.gpr[rs] >= 0) {
-					branchNext =
-						mem.mem[reg.pc + 1] +
-						(signExtend(immediate) << 2);
-				} else {
-					reg.pc++;
-				}
-				break;
-			case 0b00000000: /* BLTZ */
-				if (reg.gpr[rs] < 0) {
-					branchNext =
-						mem.mem[reg.pc + 1] +
-						(signExtend(immediate) << 2);
-				}
-				break;
-			case 0b00010000: /* BLTZAL */
-				reg.gpr[31] = mem.mem[reg.pc + 1];
-				if (reg.gpr[rs] < 0) {
-					branchNext =
-						mem.mem[reg.pc + 1] +
-						(signExtend(immediate) << 2);
-				}
-				break;
-			case 0b00010010: /* BLTZALL */
-				reg.gpr[31] = mem.mem[reg.pc + 1];
-				if (reg.gpr[rs] < 0) {
-					branchNext =
-						mem.mem[reg.pc + 1] +
-						(signExtend(immediate) << 2);
-				} else {
-					reg.pc++;
-				}
-				break;
-			case 0b00000010: /* BLTZL */
-				if (reg.gpr[rs] < 0) {
-					branchNext =
-						mem.mem[reg.pc + 1] +
-						(signExtend(immediate) << 2);
-				} else {
-					reg.pc++;
-				}
-				break;
-			}
-			break;
-		case 0b00000111:
-			switch (rt) {
-			case 0b00000000: /* BGTZ */
-				if (reg.gpr[rs] > 0) {
-					branchNext =
-						mem.mem[reg.pc + 1] +
-						(signExtend(immediate) << 2);
-				}
-				break;
-			}
-			break;
-		case 0b00010111:
-			switch (rt) {
-			case 0b00000000: /* BGTZL */
-				if (reg.gpr[rs] > 0) {
-					branchNext =
-						mem.mem[reg.pc + 1] +
-						(signExtend(immediate) << 2);
-				} else {
-					reg.pc++;
-				}
-				break;
-			}
-			break;
-		case 0b00000110:
-			switch (rt) {
-			case 0b00000000: /* BLEZ */
-				if (reg.gpr[rs] <= 0) {
-					branchNext =
-						mem.mem[reg.pc + 1] +
-						(signExtend(immediate) << 2);
-				}
-				break;
-			}
-			break;
-		case 0b00010110:
-			switch (rt) {
-			case 0b00000000: /* BLEZL */
-				if (reg.gpr[rs] <= 0) {
-					branchNext =
-						mem.mem[reg.pc + 1] +
-						(signExtend(immediate) << 2);
-				} else {
-					reg.pc++;
-				}
-				break;
-			}
-			break;
-		case 0b00000101: /* BNE */
-			if (reg.gpr[rs] != reg.gpr[rt]) {
-				branchNext = mem.mem[reg.pc + 1] +
-					     (signExtend(immediate) << 2);
-			}
-			break;
-		case 0b00010101: /* BNEL */
-			if (reg.gpr[rs] != reg.gpr[rt]) {
-				branchNext = mem.mem[reg.pc + 1] +
-					     (signExtend(immediate) << 2);
-			} else {
-				reg.pc++;
-			}
-			break;
-		case 0b00101111: /* CACHE */
-			/* TODO */
-			break;
-		case 0b00011000: /* DADDI */
-			/*
-			 * Note: Should only run in 64
-			 * bit mode or 32 bit kernel
-			 * mode. Otherwise throw
-			 * reserved instruction
-			 * exception.
-			 */
-			if (reg.gpr[rs] <
-			    INT_MAX - reg.gpr[rt]) {
-				/* Add integer overflow code! */
-			} else {
-				reg.gpr[rt] = (signExtend(immediate) +
-					       (signed)reg.gpr[rs]);
-			}
+	reg->cop0[COP0Count] = (uint32_t)(value - (uint32_t)(sched->cycles / 2));
+	scheduleCompare();
+}
+
+void
+cpuWriteCompare(uint32_t value)
+{
+	reg->cop0[COP0Compare] = value;
+	reg->cop0[COP0Cause] &= ~causeIP7;
+	scheduleCompare();
+}
+
+void
+compareReached()
+{
+	reg->cop0[COP0Cause] |= causeIP7;
+	scheduleCompare();
+	cpuCheckInterrupts();
+}
+
+uint64_t
+VR4300::readCOP0(int rd)
+{
+	if (rd == COP0Count) {
+		return cpuReadCount();
+	}
+	return reg->cop0[rd];
+}
+
+void
+VR4300::writeCOP0(int rd, uint64_t value)
+{
+	switch (rd) {
+	case COP0Count:
+		cpuWriteCount((uint32_t)value);
+		break;
+	case COP0Compare:
+		cpuWriteCompare((uint32_t)value);
+		break;
+	case COP0Cause:
+		/* Only the software interrupts */
+		reg->cop0[rd] = (reg->cop0[rd] & ~0x300ull) | (value & 0x300);
+		cpuCheckInterrupts();
+		break;
+	case COP0Status:
+		reg->cop0[rd] = value;
+		cpuCheckInterrupts();
 		break;
-		case 0b00011001: /* DADDIU */
+	default:
+		reg->cop0[rd] = value;
+		break;
+	}
+}
+
+template <class P>
+static void
+run(uint64_t until)
+{
+	ExecState &e = VR4300::exec();
+
+	schedule(EventYield, until);
+	/* Leave when cpuWatch() asks for the other variant */
+	while (sched->cycles < until && !emu->debug.stopped &&
+	       (emu->vr4300.watchUsers != 0) == P::watch) {
+		/*
+		 * One instruction per cycle until something is due. Anything
+		 * that may raise an interrupt schedules EventInterrupt, so
+		 * this loop never tests for one itself.
+		 */
+		while (sched->cycles < sched->next) {
+			step<VR4300, P>();
+			sched->cycles++;
 			/*
-			 * Note: Should only run in 64
-			 * bit mode or 32 bit kernel
-			 * mode. Otherwise throw
-			 * reserved instruction
-			 * exception.
+			 * A backward transfer right after a delay slot may close
+			 * an idle loop; if so nothing changes until the next
+			 * event, so jump there.
 			 */
-			reg.gpr[rt] = (signExtend(immediate) +
-				       (signed)reg.gpr[rs]);
-		default:
-			/* Add unknown opcode! */
-			break;
-			if (branchNext >= 0) {
-				reg.pc = branchNext;
-				branchNext = -1;
+			if (e.inDelaySlot && reg->pc <= e.currentPC &&
+			    idleLoop(e.currentPC - 4, reg->pc)) {
+				sched->cycles = sched->next;
 			}
 		}
-		/* Interpreter ends HERE, parser follows */
-	} else {
-		switch (op) {
-		case 0b00000000: /* ADD */
-			std::cout << "ADD";
-			break;
-		case 0b00001000: /* ADDI */
-			std::cout << "ADDI";
-			break;
-		case 0b00001001: /* ADDIU */
-			std::cout << "ADDIU";
-			break;
-		case 0b00101111: /* CACHE */
-			/* TODO */
-			break;
-		case 0b00010000:
-			if ((sa == 0) && (funct == 0)) {
-				switch (rs) {
-				case 0b00000010: /* CFC0 */
-					/* TODO */
-					break;
-				}
-			} else {
-				switch (rs) {
-				case 0b00001000:
-					switch (rt) {
-					case 0b00000000: /* BC0F */
-						/* TODO */
-						break;
-					case 0b00000010: /* BC0FL */
-						/* TODO */
-						break;
-					case 0b00000001: /* BC0T */
-						/* TODO */
-						break;
-					case 0b00000011: /* BC0TL */
-						/* TODO */
-						break;
-					}
-					break;
-				case 0b00010000: /* COP0 */
-					/* TODO */
-					break;
-				case 0b0000110:
-					if (opcode &
-					    0b00000000000000000000011111111111) { /* CTC0 */
-						/* TODO */
-					}
-					break;
-				}
-			}
-			break;
-		case 0b00010001:
-			if ((sa == 0) && (funct == 0)) {
-				switch (rs) {
-				case 0b00000010: /* CFC1 */
-					/* TODO */
-					break;
-				}
-			} else {
-				switch (rs) {
-				case 0b00001000:
-					switch (rt) {
-					case 0b00000000: /* BC1F */
-						/* TODO */
-						break;
-					case 0b00000010: /* BC1FL */
-						/* TODO */
-						break;
-					case 0b00000001: /* BC1T */
-						/* TODO */
-						break;
-					case 0b00000011: /* BC1TL */
-						/* TODO */
-						break;
-					}
-					break;
-				case 0b00010000: /* COP1 */
-					/* TODO */
-					break;
-				case 0b0000110:
-					if (opcode &
-					    0b00000000000000000000011111111111) { /* CTC1 */
-						/* TODO */
-					}
-					break;
-				}
-			}
-			break;
-		case 0b00010010:
-			if ((sa == 0) && (funct == 0)) {
-				switch (rs) {
-				case 0b00000010: /* CFC2 */
-					/* TODO */
-					break;
-				}
-			} else {
-				switch (rs) {
-				case 0b00001000:
-					switch (rt) {
-					case 0b00000000: /* BC2F */
-						/* TODO */
-						break;
-					case 0b00000010: /* BC2FL */
-						/* TODO */
-						break;
-					case 0b00000001: /* BC2T */
-						/* TODO */
-						break;
-					case 0b00000011: /* BC2TL */
-						/* TODO */
-						break;
-					}
-					break;
-				case 0b00010000: /* COP2 */
-					/* TODO */
-					break;
-				case 0b0000110:
-					if (opcode &
-					    0b00000000000000000000011111111111) { /* CTC2 */
-						/* TODO */
-					}
-					break;
-				}
-			}
-			break;
-		case 0b00010011:
-			if ((sa == 0) && (funct == 0)) {
-				switch (rs) {
-				case 0b00000010: /* CFC3 */
-					/* TODO */
-					break;
-				}
-			} else {
-				switch (rs) {
-				case 0b00001000:
-					switch (rt) {
-					case 0b00000000: /* BC3F */
-						/* TODO */
-						break;
-					case 0b00000010: /* BC3FL */
-						/* TODO */
-						break;
-					case 0b00000001: /* BC3T */
-						/* TODO */
-						break;
-					case 0b00000011: /* BC3TL */
-						/* TODO */
-						break;
-					}
-					break;
-				case 0b00010000: /* COP3 */
-					/* TODO */
-					break;
-				case 0b0000110:
-					if (opcode &
-					    0b00000000000000000000011111111111) { /* CTC3 */
-						/* TODO */
-					}
-					break;
-				}
-			}
-			break;
-		default:
-			/* Add unknown opcode! */
+		runEvents();
+	}
+}
+
+void
+runCPU(uint64_t until)
+{
+	TIMER_SCOPE(TimerCPU);
+	TIMELINE_SPAN("cpu");
+	VR4300State &s = emu->vr4300;
+
+	for (;;) {
+		s.run(until);
+		bool watch = s.watchUsers != 0;
+		if (s.options.watch == watch) {
 			break;
 		}
+		/* Switch between instructions, where no handler is running */
+		CPUOptions options = s.options;
+		options.watch = watch;
+		cpuConfigure(options);
+	}
+}
+
+void
+cpuConfigure(const CPUOptions &options)
+{
+	/* Indexed by mode64, strictOverflow, trace, watch */
+	static void (*const runners[2][2][2][2])(uint64_t) = {
+		{
+			{
+				{ run<Policy<false, false, false, false>>,
+				  run<Policy<false, false, false, true>> },
+				{ run<Policy<false, false, true, false>>,
+				  run<Policy<false, false, true, true>> },
+			},
+			{
+				{ run<Policy<false, true, false, false>>,
+				  run<Policy<false, true, false, true>> },
+				{ run<Policy<false, true, true, false>>,
+				  run<Policy<false, true, true, true>> },
+			},
+		},
+		{
+			{
+				{ run<Policy<true, false, false, false>>,
+				  run<Policy<true, false, false, true>> },
+				{ run<Policy<true, false, true, false>>,
+				  run<Policy<true, false, true, true>> },
+			},
+			{
+				{ run<Policy<true, true, false, false>>,
+				  run<Policy<true, true, false, true>> },
+				{ run<Policy<true, true, true, false>>,
+				  run<Policy<true, true, true, true>> },
+			},
+		},
+	};
+
+	emu->vr4300.options = options;
+	emu->vr4300.run = runners[options.mode64][options.strictOverflow]
+				 [options.trace][options.watch];
+	/* Cached handlers belong to the old policy */
+	flushDecoded();
+	rspConfigure(options);
+}
+
+void
+cpuWatch(bool enable)
+{
+	VR4300State &s = emu->vr4300;
+
+	s.watchUsers += enable ? 1 : -1;
+	if (s.options.watch != (s.watchUsers != 0)) {
+		/* End the current batch so run() notices; runEvents() fixes next */
+		sched->next = sched->cycles;
+	}
+}
+
+void
+cpuReset()
+{
+	reg->pc = 0xffffffffbfc00000ull;
+	reg->nextPC = reg->pc + 4;
+	reg->delaySlot = false;
+	reg->cop0[COP0Status] = statusERL | statusBEV;
+}
+
+/*
+ * Enter the general exception vector. pc is the instruction that did not
+ * complete; if it sits in a delay slot EPC points at its branch instead,
+ * so that returning re-executes both.
+ */
+static void
+enterException(ExceptionCode code, int coprocessor, uint64_t pc, bool delaySlot)
+{
+	uint64_t &status = reg->cop0[COP0Status];
+	uint64_t &cause = reg->cop0[COP0Cause];
+
+	cause = (cause & ~0x3000007cull) | (uint64_t)code << 2 |
+		(uint64_t)coprocessor << 28;
+	if (!(status & statusEXL)) {
+		reg->cop0[COP0EPC] = delaySlot ? pc - 4 : pc;
+		cause = delaySlot ? cause | causeBD : cause & ~causeBD;
+		status |= statusEXL;
+	}
+	uint64_t vector = (status & statusBEV) ? 0xffffffffbfc00200ull
+					       : 0xffffffff80000000ull;
+	reg->pc = vector + 0x180;
+	reg->nextPC = reg->pc + 4;
+	reg->delaySlot = false;
+}
+
+void
+cpuException(ExceptionCode code, int coprocessor)
+{
+	ExecState &e = VR4300::exec();
+
+	enterException(code, coprocessor, e.currentPC, e.inDelaySlot);
+}
+
+static bool
+interruptPending()
+{
+	uint64_t status = reg->cop0[COP0Status];
+
+	return (status & reg->cop0[COP0Cause] & 0xff00) &&
+	       (status & (statusIE | statusEXL | statusERL)) == statusIE;
+}
+
+void
+cpuCheckInterrupts()
+{
+	uint64_t &cause = reg->cop0[COP0Cause];
+
+	cause = miPending() ? cause | causeIP2 : cause & ~causeIP2;
+	if (interruptPending()) {
+		schedule(EventInterrupt, sched->cycles);
+	}
+}
+
+void
+cpuInterrupt()
+{
+	/* Taken between instructions: pc has not started yet. */
+	if (interruptPending()) {
+		enterException(ExcInterrupt, 0, reg->pc, reg->delaySlot);
+	}
+}
+
+void
+VR4300::eret()
+{
+	uint64_t &status = reg->cop0[COP0Status];
+
+	if (status & statusERL) {
+		reg->pc = reg->cop0[COP0ErrorEPC];
+		status &= ~statusERL;
+	} else {
+		reg->pc = reg->cop0[COP0EPC];
+		status &= ~statusEXL;
 	}
+	reg->nextPC = reg->pc + 4;
+	reg->delaySlot = false;
+	reg->llbit = false;
+	cpuCheckInterrupts();
 }
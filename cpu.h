@@ -29,21 +29,140 @@
 #include <cstdint>
 
 struct Registers {
+	/* pc executes next, then nextPC; delaySlot if pc is a delay slot */
 	uint64_t pc;
+	uint64_t nextPC;
+	bool delaySlot;
 	uint64_t hi;
 	uint64_t lo;
 	uint64_t gpr[32];
 	bool llbit;
-	double fpr[32];
-	float fcr0;
-	float fcr31;
+	/* Raw FPU register bits, see fpu.h for FR=0 pairing */
+	uint64_t fpr[32];
+	uint32_t fcr31;
+	uint64_t cop0[32];
 };
 
-extern Registers reg;
+extern thread_local Registers *reg;
 
-extern uint16_t signExtend(uint8_t);
-extern uint32_t signExtend(uint16_t);
-extern uint64_t signExtend(uint32_t);
+enum COP0Register {
+	COP0Index = 0,
+	COP0Random = 1,
+	COP0BadVAddr = 8,
+	COP0Count = 9,
+	COP0Compare = 11,
+	COP0Status = 12,
+	COP0Cause = 13,
+	COP0EPC = 14,
+	COP0PRId = 15,
+	COP0Config = 16,
+	COP0ErrorEPC = 30,
+};
+
+static const uint64_t statusIE = 1 << 0;
+static const uint64_t statusEXL = 1 << 1;
+static const uint64_t statusERL = 1 << 2;
+static const uint64_t statusBEV = 1 << 22;
+static const uint64_t statusFR = 1 << 26;
+static const uint64_t statusCU1 = 1 << 29;
+
+static const uint64_t causeIP2 = 1 << 10;
+static const uint64_t causeIP7 = 1 << 15;
+static const uint64_t causeBD = 1ull << 31;
+
+enum ExceptionCode {
+	ExcInterrupt = 0,
+	ExcAddressLoad = 4,
+	ExcAddressStore = 5,
+	ExcSyscall = 8,
+	ExcBreakpoint = 9,
+	ExcReserved = 10,
+	ExcCoprocessor = 11,
+	ExcOverflow = 12,
+	ExcTrap = 13,
+	ExcFloatingPoint = 15,
+};
+
+/*
+ * COUNT is not stored: it is derived from sched->cycles when read, and
+ * cop0[COP0Count] holds its offset from sched->cycles / 2. The COMPARE
+ * interrupt is a scheduled event that is recomputed whenever COUNT or
+ * COMPARE is written.
+ */
+extern uint32_t
+cpuReadCount();
 
 extern void
-execCPU(uint32_t, int, bool);
+cpuWriteCount(uint32_t value);
+
+extern void
+cpuWriteCompare(uint32_t value);
+
+/* EventCompare handler. */
+extern void
+compareReached();
+
+/* Run the CPU up to the given cycle, servicing events on the way. */
+extern void
+runCPU(uint64_t until);
+
+/* Cold reset: start at the boot ROM vector with ERL and BEV set. */
+extern void
+cpuReset();
+
+/*
+ * Enter the general exception vector from the current instruction,
+ * setting EPC and Cause.BD precisely even inside a delay slot.
+ */
+extern void
+cpuException(ExceptionCode code, int coprocessor = 0);
+
+/*
+ * Refresh Cause.IP2 from the MI and, if an enabled interrupt is now
+ * pending, schedule EventInterrupt for the current cycle. Anything that
+ * can change the interrupt lines or masks must call this; the CPU does
+ * not poll for interrupts otherwise.
+ */
+extern void
+cpuCheckInterrupts();
+
+/* EventInterrupt handler, taken between two instructions. */
+extern void
+cpuInterrupt();
+
+/*
+ * Interpreter variants, chosen once at startup. The defaults favour
+ * speed: 64-bit operations are legal, as in the kernel mode games run
+ * in, and signed overflow wraps instead of trapping.
+ */
+struct CPUOptions {
+	bool mode64 = true;
+	bool strictOverflow = false;
+	bool trace = false;
+	/* Set while cpuWatch() has users */
+	bool watch = false;
+};
+
+extern void
+cpuConfigure(const CPUOptions &options);
+
+/*
+ * Loads and stores that touch an RDRAM page with bits set in
+ * emu->vr4300.watchPages are reported to each consumer whose bit is set.
+ * Checking for them takes the watch policy (see mips.h), which the CPU
+ * runs under while anyone holds cpuWatch(true); otherwise the table is
+ * never looked at.
+ */
+enum WatchConsumer : uint8_t {
+	WatchDebugger = 1 << 0,
+	WatchReadback = 1 << 1,
+};
+
+/*
+ * Take (true) or drop (false) a reference on the watch policy. Safe to
+ * call from inside a handler or event: runCPU() switches variants after
+ * the current instruction, or at the start of the next run.
+ */
+extern void
+cpuWatch(bool enable);
+
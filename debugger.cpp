@@ -0,0 +1,371 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstdlib>
+
+#include "bus.h"
+#include "debugger.h"
+#include "disasm.h"
+#include "emulator.h"
+#include "gui/imgui.h"
+#include "scheduler.h"
+
+/* KSEG0/KSEG1 only until there is a TLB */
+static inline uint32_t
+physical(uint64_t addr)
+{
+	return addr & 0x1fffffff;
+}
+
+static Breakpoint *
+findBreakpoint(uint32_t paddr)
+{
+	for (Breakpoint &b : emu->debug.breakpoints) {
+		if (b.paddr == paddr) {
+			return &b;
+		}
+	}
+	return nullptr;
+}
+
+/* Count a breakpoint on its page and make the page decode again. */
+static void
+touchBreakPage(uint32_t paddr, int delta)
+{
+	if (paddr < rdramSize) {
+		uint32_t page = paddr >> rdramPageShift;
+		emu->debug.breakPages[page] += delta;
+		mem->dirty[page] |= DirtyDecode;
+	}
+}
+
+/* Count a watchpoint on the pages it covers. */
+static void
+touchWatchPages(const Watchpoint &w, int delta)
+{
+	DebugState &dbg = emu->debug;
+	uint32_t last = (w.paddr + w.size - 1) >> rdramPageShift;
+
+	for (uint32_t page = w.paddr >> rdramPageShift; page <= last; page++) {
+		dbg.watchCounts[page] += delta;
+		if (dbg.watchCounts[page]) {
+			emu->vr4300.watchPages[page] |= WatchDebugger;
+		} else {
+			emu->vr4300.watchPages[page] &= ~WatchDebugger;
+		}
+	}
+}
+
+bool
+debugAddBreakpoint(uint64_t addr)
+{
+	uint32_t paddr = physical(addr) & ~3u;
+
+	if (findBreakpoint(paddr)) {
+		return false;
+	}
+	emu->debug.breakpoints.push_back({ paddr, nullptr });
+	touchBreakPage(paddr, 1);
+	return true;
+}
+
+void
+debugRemoveBreakpoint(uint64_t addr)
+{
+	std::vector<Breakpoint> &list = emu->debug.breakpoints;
+	uint32_t paddr = physical(addr) & ~3u;
+
+	for (size_t i = 0; i < list.size(); i++) {
+		if (list[i].paddr == paddr) {
+			list.erase(list.begin() + i);
+			touchBreakPage(paddr, -1);
+			return;
+		}
+	}
+}
+
+bool
+debugAddWatchpoint(uint64_t addr, uint32_t size, bool read, bool write)
+{
+	std::vector<Watchpoint> &list = emu->debug.watchpoints;
+	uint32_t paddr = physical(addr);
+
+	if (!size || (uint64_t)paddr + size > rdramSize || !(read || write)) {
+		return false;
+	}
+	list.push_back({ paddr, size, read, write });
+	touchWatchPages(list.back(), 1);
+	if (list.size() == 1) {
+		cpuWatch(true);
+	}
+	return true;
+}
+
+void
+debugRemoveWatchpoint(size_t i)
+{
+	std::vector<Watchpoint> &list = emu->debug.watchpoints;
+
+	touchWatchPages(list[i], -1);
+	list.erase(list.begin() + i);
+	if (list.empty()) {
+		cpuWatch(false);
+	}
+}
+
+void
+debugContinue()
+{
+	DebugState &dbg = emu->debug;
+
+	dbg.resuming = dbg.stopped == StopBreakpoint;
+	dbg.resumeCycle = sched->cycles;
+	dbg.stopped = StopNone;
+}
+
+/* Stop the run loop once the current instruction is done. */
+static void
+stop(StopReason reason, uint64_t pc, uint32_t paddr)
+{
+	DebugState &dbg = emu->debug;
+
+	dbg.stopped = reason;
+	dbg.stopPC = pc;
+	dbg.stopAddress = paddr;
+	/* runEvents() puts next back */
+	sched->next = sched->cycles;
+}
+
+void
+debugPatch(Decoded &d, uint32_t paddr)
+{
+	Breakpoint *b = findBreakpoint(paddr);
+
+	if (b) {
+		b->handler = d.handler;
+		d.handler = debugBreakpoint;
+	}
+}
+
+void
+debugBreakpoint(const Decoded &d)
+{
+	DebugState &dbg = emu->debug;
+	ExecState &e = emu->vr4300.exec;
+	/* Removing a breakpoint redecodes its page, so it is still there */
+	Breakpoint *b = findBreakpoint(physical(e.currentPC));
+
+	bool resume = dbg.resuming && dbg.resumeCycle == sched->cycles &&
+		      dbg.stopPC == e.currentPC;
+	dbg.resuming = false;
+	if (resume) {
+		b->handler(d);
+		return;
+	}
+
+	/* Back out of step() as if the instruction had not started */
+	reg->nextPC = reg->pc;
+	reg->pc = e.currentPC;
+	reg->delaySlot = e.inDelaySlot;
+	e.inDelaySlot = false;
+	/* and give back the cycle the run loop is about to count */
+	sched->cycles--;
+	stop(StopBreakpoint, e.currentPC, 0);
+}
+
+void
+debugWatchAccess(uint32_t paddr, int size, bool write)
+{
+	DebugState &dbg = emu->debug;
+
+	for (const Watchpoint &w : dbg.watchpoints) {
+		if (paddr < w.paddr + w.size && w.paddr < paddr + size &&
+		    (write ? w.write : w.read)) {
+			stop(write ? StopWatchWrite : StopWatchRead,
+			     emu->vr4300.exec.currentPC, paddr);
+			return;
+		}
+	}
+}
+
+void
+debuggerSync(Emulator *e)
+{
+	DebugView &v = e->debug.view;
+	std::lock_guard<std::mutex> lock(v.lock);
+	Emulator *previous = emulatorBind(e);
+	DebugState &dbg = e->debug;
+
+	for (const DebugCommand &c : v.commands) {
+		switch (c.type) {
+		case CommandAddBreakpoint:
+			debugAddBreakpoint(c.addr);
+			break;
+		case CommandRemoveBreakpoint:
+			debugRemoveBreakpoint(c.addr);
+			break;
+		case CommandAddWatchpoint:
+			debugAddWatchpoint(c.addr, c.size, c.read, c.write);
+			break;
+		case CommandRemoveWatchpoint:
+			for (size_t i = 0; i < dbg.watchpoints.size(); i++) {
+				const Watchpoint &w = dbg.watchpoints[i];
+				if (w.paddr == c.addr && w.size == c.size &&
+				    w.read == c.read && w.write == c.write) {
+					debugRemoveWatchpoint(i);
+					break;
+				}
+			}
+			break;
+		case CommandContinue:
+			debugContinue();
+			break;
+		}
+	}
+	v.commands.clear();
+
+	v.stopped = dbg.stopped;
+	v.stopPC = dbg.stopPC;
+	v.stopAddress = dbg.stopAddress;
+	if (dbg.stopped != StopNone) {
+		v.stopOpcode = busRead32(physical(dbg.stopPC));
+	}
+	v.breakpoints.clear();
+	for (const Breakpoint &b : dbg.breakpoints) {
+		v.breakpoints.push_back(b.paddr);
+	}
+	v.watchpoints = dbg.watchpoints;
+
+	emulatorBind(previous);
+}
+
+void
+debuggerWindow(Emulator *e, bool *open)
+{
+	static char breakAddress[17];
+	static char watchAddress[17];
+	static int watchSize = 4;
+	static bool watchRead;
+	static bool watchWrite = true;
+	/* The window's copy of the view, so drawing holds no lock */
+	static DebugView shown;
+	std::vector<DebugCommand> commands;
+
+	if (!ImGui::Begin("Debugger", open)) {
+		ImGui::End();
+		return;
+	}
+
+	DebugView &v = e->debug.view;
+	{
+		std::lock_guard<std::mutex> lock(v.lock);
+		shown.stopped = v.stopped;
+		shown.stopPC = v.stopPC;
+		shown.stopOpcode = v.stopOpcode;
+		shown.stopAddress = v.stopAddress;
+		shown.breakpoints = v.breakpoints;
+		shown.watchpoints = v.watchpoints;
+	}
+
+	if (shown.stopped == StopNone) {
+		ImGui::TextUnformatted("Running");
+	} else {
+		char text[disasmMaxLength];
+		disassembleVR4300(shown.stopOpcode, shown.stopPC, text,
+				  sizeof(text));
+		ImGui::Text("Stopped at %08x: %s", (uint32_t)shown.stopPC, text);
+		if (shown.stopped != StopBreakpoint) {
+			ImGui::Text("%s %08x",
+				    shown.stopped == StopWatchRead ? "Read of"
+								   : "Write to",
+				    shown.stopAddress);
+		}
+		if (ImGui::Button("Continue")) {
+			commands.push_back({ CommandContinue, 0, 0, false, false });
+		}
+	}
+	ImGui::Separator();
+
+	ImGui::TextUnformatted("Breakpoints");
+	ImGui::InputText("##break", breakAddress, sizeof(breakAddress),
+			 ImGuiInputTextFlags_CharsHexadecimal);
+	ImGui::SameLine();
+	if (ImGui::Button("Add##break")) {
+		commands.push_back({ CommandAddBreakpoint,
+				     strtoull(breakAddress, nullptr, 16), 0,
+				     false, false });
+	}
+	for (size_t i = 0; i < shown.breakpoints.size(); i++) {
+		uint32_t paddr = shown.breakpoints[i];
+		ImGui::PushID((int)i);
+		ImGui::Text("%08x", paddr);
+		ImGui::SameLine();
+		if (ImGui::SmallButton("Remove")) {
+			commands.push_back({ CommandRemoveBreakpoint, paddr, 0,
+					     false, false });
+		}
+		ImGui::PopID();
+	}
+	ImGui::Separator();
+
+	ImGui::TextUnformatted("Watchpoints");
+	ImGui::InputText("##watch", watchAddress, sizeof(watchAddress),
+			 ImGuiInputTextFlags_CharsHexadecimal);
+	ImGui::SameLine();
+	ImGui::PushItemWidth(80);
+	ImGui::InputInt("Size", &watchSize);
+	ImGui::PopItemWidth();
+	ImGui::SameLine();
+	ImGui::Checkbox("Read", &watchRead);
+	ImGui::SameLine();
+	ImGui::Checkbox("Write", &watchWrite);
+	ImGui::SameLine();
+	if (ImGui::Button("Add##watch") && watchSize > 0) {
+		commands.push_back({ CommandAddWatchpoint,
+				     strtoull(watchAddress, nullptr, 16),
+				     (uint32_t)watchSize, watchRead,
+				     watchWrite });
+	}
+	for (size_t i = 0; i < shown.watchpoints.size(); i++) {
+		const Watchpoint &w = shown.watchpoints[i];
+		ImGui::PushID((int)i + 0x10000);
+		ImGui::Text("%08x+%u %c%c", w.paddr, w.size, w.read ? 'r' : '-',
+			    w.write ? 'w' : '-');
+		ImGui::SameLine();
+		if (ImGui::SmallButton("Remove")) {
+			commands.push_back({ CommandRemoveWatchpoint, w.paddr,
+					     w.size, w.read, w.write });
+		}
+		ImGui::PopID();
+	}
+
+	if (!commands.empty()) {
+		std::lock_guard<std::mutex> lock(v.lock);
+		v.commands.insert(v.commands.end(), commands.begin(),
+				  commands.end());
+	}
+	ImGui::End();
+}
@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "mem.h"
+#include "mips.h"
+
+struct Emulator;
+
+/*
+ * Breakpoints and watchpoints on the VR4300. Neither costs anything
+ * while none are set.
+ *
+ * Breakpoints live in the decoded instruction cache: fetch() patches
+ * the handler of a breakpoint's Decoded to debugBreakpoint() while
+ * decoding a page that holds any, and adding or removing one just makes
+ * its page decode again. Every other instruction runs as before.
+ *
+ * Watchpoints need to see data accesses, so while any exist the CPU runs
+ * under the watch policy (see cpuWatch()), and pages with a watchpoint
+ * are marked WatchDebugger. Only accesses to those pages search the
+ * watch list. Removing the last one switches back to the normal run
+ * loop. Only RDRAM can be watched.
+ *
+ * A hit stops the instance: emulatorRun() returns early and does nothing
+ * until debugContinue(). A breakpoint stops before its instruction, a
+ * watchpoint after the access. Addresses are physical; virtual ones are
+ * folded as KSEG0/KSEG1 are. All of this must be called with the
+ * instance bound and not running.
+ */
+
+enum StopReason {
+	StopNone,
+	StopBreakpoint,
+	StopWatchRead,
+	StopWatchWrite,
+};
+
+struct Breakpoint {
+	uint32_t paddr;
+	/* The handler patched over, refreshed whenever it is decoded */
+	void (*handler)(const Decoded &d);
+};
+
+struct Watchpoint {
+	uint32_t paddr;
+	uint32_t size;
+	bool read;
+	bool write;
+};
+
+enum DebugCommandType {
+	CommandAddBreakpoint,
+	CommandRemoveBreakpoint,
+	CommandAddWatchpoint,
+	CommandRemoveWatchpoint,
+	CommandContinue,
+};
+
+struct DebugCommand {
+	DebugCommandType type;
+	uint64_t addr;
+	uint32_t size;
+	bool read;
+	bool write;
+};
+
+/*
+ * What the debugger window shows and asks for. The window draws on
+ * another thread than the one running the instance, so it only queues
+ * commands and reads a copy of the state; debuggerSync() exchanges
+ * both between frames. lock is only held for the exchange.
+ */
+struct DebugView {
+	std::mutex lock;
+	std::vector<DebugCommand> commands;
+	StopReason stopped;
+	uint64_t stopPC;
+	uint32_t stopOpcode;
+	uint32_t stopAddress;
+	std::vector<uint32_t> breakpoints;
+	std::vector<Watchpoint> watchpoints;
+};
+
+struct DebugState {
+	std::vector<Breakpoint> breakpoints;
+	std::vector<Watchpoint> watchpoints;
+	/* Number of breakpoints and watchpoints on each RDRAM page */
+	uint16_t breakPages[rdramPages];
+	uint16_t watchCounts[rdramPages];
+	StopReason stopped;
+	/* The instruction that stopped, and the address it accessed */
+	uint64_t stopPC;
+	uint32_t stopAddress;
+	/* Run the breakpoint at stopPC once when continuing */
+	bool resuming;
+	uint64_t resumeCycle;
+	DebugView view;
+};
+
+/* Returns false if there already is one at the address. */
+extern bool
+debugAddBreakpoint(uint64_t addr);
+
+extern void
+debugRemoveBreakpoint(uint64_t addr);
+
+/*
+ * Stop on reads and/or writes overlapping [addr, addr + size). Returns
+ * false unless the range is in RDRAM and at least one of read and write
+ * is set.
+ */
+extern bool
+debugAddWatchpoint(uint64_t addr, uint32_t size, bool read, bool write);
+
+/* Remove the watchpoint at index i of emu->debug.watchpoints. */
+extern void
+debugRemoveWatchpoint(size_t i);
+
+/* Resume a stopped instance on its next emulatorRun(). */
+extern void
+debugContinue();
+
+/* Called by fetch() for a freshly decoded instruction at paddr. */
+extern void
+debugPatch(Decoded &d, uint32_t paddr);
+
+/* The handler of instructions with a breakpoint. */
+extern void
+debugBreakpoint(const Decoded &d);
+
+/* Called under the watch policy for an access to a watched page. */
+extern void
+debugWatchAccess(uint32_t paddr, int size, bool write);
+
+/*
+ * Apply the debugger window's commands to e and publish its state for
+ * the window. Called by the thread running e, between emulatorRun()s.
+ */
+extern void
+debuggerSync(Emulator *e);
+
+/*
+ * Breakpoint and watchpoint lists, stop status and Continue. Safe to draw
+ * while e runs on another thread; changes take effect at the next
+ * debuggerSync().
+ */
+extern void
+debuggerWindow(Emulator *e, bool *open);
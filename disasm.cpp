@@ -0,0 +1,696 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bits.h"
+#include "disasm.h"
+
+/*
+ * Each instruction is a mnemonic and an operand string read by
+ * operands() below, one letter per operand:
+ *
+ *	d s t		GPR in the rd, rs or rt field
+ *	a		shift amount
+ *	i u		signed or unsigned 16-bit immediate
+ *	b j		branch or jump target
+ *	o		imm(rs) memory operand
+ *	k		CACHE operation
+ *	D S T		FPR in the sa, rd or rt field
+ *	c		COP1 control register in the rd field
+ *	0		COP0 register in the rd field
+ *	2		COP2 control register in the rd field
+ *	V W X		vector register in the sa, rd or rt field
+ *	e		vector element selector in the rs field
+ *	E		element in bits 7-10, as MFC2 and LWC2 take it
+ *	x		element of vd, from the low bits of the rd field
+ *	A		accumulator slice selected by the element field
+ *	O		vector load/store memory operand
+ */
+struct Op {
+	const char *name;
+	const char *operands;
+	/* Which cores have it */
+	uint8_t cores;
+};
+
+enum {
+	CPU = 1,
+	RSP = 2,
+	Both = CPU | RSP,
+};
+
+static const Op primary[64] = {
+	{},
+	{},
+	{ "j", "j", Both },
+	{ "jal", "j", Both },
+	{ "beq", "s,t,b", Both },
+	{ "bne", "s,t,b", Both },
+	{ "blez", "s,b", Both },
+	{ "bgtz", "s,b", Both },
+	{ "addi", "t,s,i", Both },
+	{ "addiu", "t,s,i", Both },
+	{ "slti", "t,s,i", Both },
+	{ "sltiu", "t,s,i", Both },
+	{ "andi", "t,s,u", Both },
+	{ "ori", "t,s,u", Both },
+	{ "xori", "t,s,u", Both },
+	{ "lui", "t,u", Both },
+	{},
+	{},
+	{},
+	{},
+	{ "beql", "s,t,b", CPU },
+	{ "bnel", "s,t,b", CPU },
+	{ "blezl", "s,b", CPU },
+	{ "bgtzl", "s,b", CPU },
+	{ "daddi", "t,s,i", CPU },
+	{ "daddiu", "t,s,i", CPU },
+	{ "ldl", "t,o", CPU },
+	{ "ldr", "t,o", CPU },
+	{},
+	{},
+	{},
+	{},
+	{ "lb", "t,o", Both },
+	{ "lh", "t,o", Both },
+	{ "lwl", "t,o", CPU },
+	{ "lw", "t,o", Both },
+	{ "lbu", "t,o", Both },
+	{ "lhu", "t,o", Both },
+	{ "lwr", "t,o", CPU },
+	{ "lwu", "t,o", Both },
+	{ "sb", "t,o", Both },
+	{ "sh", "t,o", Both },
+	{ "swl", "t,o", CPU },
+	{ "sw", "t,o", Both },
+	{ "sdl", "t,o", CPU },
+	{ "sdr", "t,o", CPU },
+	{ "swr", "t,o", CPU },
+	{ "cache", "k,o", CPU },
+	{ "ll", "t,o", CPU },
+	{ "lwc1", "T,o", CPU },
+	{},
+	{},
+	{ "lld", "t,o", CPU },
+	{ "ldc1", "T,o", CPU },
+	{},
+	{ "ld", "t,o", CPU },
+	{ "sc", "t,o", CPU },
+	{ "swc1", "T,o", CPU },
+	{},
+	{},
+	{ "scd", "t,o", CPU },
+	{ "sdc1", "T,o", CPU },
+	{},
+	{ "sd", "t,o", CPU },
+};
+
+static const Op special[64] = {
+	{ "sll", "d,t,a", Both },
+	{},
+	{ "srl", "d,t,a", Both },
+	{ "sra", "d,t,a", Both },
+	{ "sllv", "d,t,s", Both },
+	{},
+	{ "srlv", "d,t,s", Both },
+	{ "srav", "d,t,s", Both },
+	{ "jr", "s", Both },
+	{ "jalr", "d,s", Both },
+	{},
+	{},
+	{ "syscall", "", CPU },
+	{ "break", "", Both },
+	{},
+	{ "sync", "", CPU },
+	{ "mfhi", "d", CPU },
+	{ "mthi", "s", CPU },
+	{ "mflo", "d", CPU },
+	{ "mtlo", "s", CPU },
+	{ "dsllv", "d,t,s", CPU },
+	{},
+	{ "dsrlv", "d,t,s", CPU },
+	{ "dsrav", "d,t,s", CPU },
+	{ "mult", "s,t", CPU },
+	{ "multu", "s,t", CPU },
+	{ "div", "s,t", CPU },
+	{ "divu", "s,t", CPU },
+	{ "dmult", "s,t", CPU },
+	{ "dmultu", "s,t", CPU },
+	{ "ddiv", "s,t", CPU },
+	{ "ddivu", "s,t", CPU },
+	{ "add", "d,s,t", Both },
+	{ "addu", "d,s,t", Both },
+	{ "sub", "d,s,t", Both },
+	{ "subu", "d,s,t", Both },
+	{ "and", "d,s,t", Both },
+	{ "or", "d,s,t", Both },
+	{ "xor", "d,s,t", Both },
+	{ "nor", "d,s,t", Both },
+	{},
+	{},
+	{ "slt", "d,s,t", Both },
+	{ "sltu", "d,s,t", Both },
+	{ "dadd", "d,s,t", CPU },
+	{ "daddu", "d,s,t", CPU },
+	{ "dsub", "d,s,t", CPU },
+	{ "dsubu", "d,s,t", CPU },
+	{ "tge", "s,t", CPU },
+	{ "tgeu", "s,t", CPU },
+	{ "tlt", "s,t", CPU },
+	{ "tltu", "s,t", CPU },
+	{ "teq", "s,t", CPU },
+	{},
+	{ "tne", "s,t", CPU },
+	{},
+	{ "dsll", "d,t,a", CPU },
+	{},
+	{ "dsrl", "d,t,a", CPU },
+	{ "dsra", "d,t,a", CPU },
+	{ "dsll32", "d,t,a", CPU },
+	{},
+	{ "dsrl32", "d,t,a", CPU },
+	{ "dsra32", "d,t,a", CPU },
+};
+
+static const Op regimm[32] = {
+	{ "bltz", "s,b", Both },
+	{ "bgez", "s,b", Both },
+	{ "bltzl", "s,b", CPU },
+	{ "bgezl", "s,b", CPU },
+	{},
+	{},
+	{},
+	{},
+	{ "tgei", "s,i", CPU },
+	{ "tgeiu", "s,i", CPU },
+	{ "tlti", "s,i", CPU },
+	{ "tltiu", "s,i", CPU },
+	{ "teqi", "s,i", CPU },
+	{},
+	{ "tnei", "s,i", CPU },
+	{},
+	{ "bltzal", "s,b", Both },
+	{ "bgezal", "s,b", Both },
+	{ "bltzall", "s,b", CPU },
+	{ "bgezall", "s,b", CPU },
+};
+
+/* COP1 arithmetic, suffixed with the format */
+static const Op cop1[64] = {
+	{ "add", "D,S,T", CPU },
+	{ "sub", "D,S,T", CPU },
+	{ "mul", "D,S,T", CPU },
+	{ "div", "D,S,T", CPU },
+	{ "sqrt", "D,S", CPU },
+	{ "abs", "D,S", CPU },
+	{ "mov", "D,S", CPU },
+	{ "neg", "D,S", CPU },
+	{ "round.l", "D,S", CPU },
+	{ "trunc.l", "D,S", CPU },
+	{ "ceil.l", "D,S", CPU },
+	{ "floor.l", "D,S", CPU },
+	{ "round.w", "D,S", CPU },
+	{ "trunc.w", "D,S", CPU },
+	{ "ceil.w", "D,S", CPU },
+	{ "floor.w", "D,S", CPU },
+	{}, {}, {}, {}, {}, {}, {}, {},
+	{}, {}, {}, {}, {}, {}, {}, {},
+	{ "cvt.s", "D,S", CPU },
+	{ "cvt.d", "D,S", CPU },
+	{},
+	{},
+	{ "cvt.w", "D,S", CPU },
+	{ "cvt.l", "D,S", CPU },
+	{}, {}, {}, {}, {}, {}, {}, {}, {}, {},
+	{ "c.f", "S,T", CPU },
+	{ "c.un", "S,T", CPU },
+	{ "c.eq", "S,T", CPU },
+	{ "c.ueq", "S,T", CPU },
+	{ "c.olt", "S,T", CPU },
+	{ "c.ult", "S,T", CPU },
+	{ "c.ole", "S,T", CPU },
+	{ "c.ule", "S,T", CPU },
+	{ "c.sf", "S,T", CPU },
+	{ "c.ngle", "S,T", CPU },
+	{ "c.seq", "S,T", CPU },
+	{ "c.ngl", "S,T", CPU },
+	{ "c.lt", "S,T", CPU },
+	{ "c.nge", "S,T", CPU },
+	{ "c.le", "S,T", CPU },
+	{ "c.ngt", "S,T", CPU },
+};
+
+/* RSP COP2 computational instructions */
+static const Op vector[64] = {
+	{ "vmulf", "V,W,Xe", RSP },
+	{ "vmulu", "V,W,Xe", RSP },
+	{ "vrndp", "V,W,Xe", RSP },
+	{ "vmulq", "V,W,Xe", RSP },
+	{ "vmudl", "V,W,Xe", RSP },
+	{ "vmudm", "V,W,Xe", RSP },
+	{ "vmudn", "V,W,Xe", RSP },
+	{ "vmudh", "V,W,Xe", RSP },
+	{ "vmacf", "V,W,Xe", RSP },
+	{ "vmacu", "V,W,Xe", RSP },
+	{ "vrndn", "V,W,Xe", RSP },
+	{ "vmacq", "V,W,Xe", RSP },
+	{ "vmadl", "V,W,Xe", RSP },
+	{ "vmadm", "V,W,Xe", RSP },
+	{ "vmadn", "V,W,Xe", RSP },
+	{ "vmadh", "V,W,Xe", RSP },
+	{ "vadd", "V,W,Xe", RSP },
+	{ "vsub", "V,W,Xe", RSP },
+	{},
+	{ "vabs", "V,W,Xe", RSP },
+	{ "vaddc", "V,W,Xe", RSP },
+	{ "vsubc", "V,W,Xe", RSP },
+	{}, {}, {}, {}, {}, {}, {},
+	{ "vsar", "V,A", RSP },
+	{},
+	{},
+	{ "vlt", "V,W,Xe", RSP },
+	{ "veq", "V,W,Xe", RSP },
+	{ "vne", "V,W,Xe", RSP },
+	{ "vge", "V,W,Xe", RSP },
+	{ "vcl", "V,W,Xe", RSP },
+	{ "vch", "V,W,Xe", RSP },
+	{ "vcr", "V,W,Xe", RSP },
+	{ "vmrg", "V,W,Xe", RSP },
+	{ "vand", "V,W,Xe", RSP },
+	{ "vnand", "V,W,Xe", RSP },
+	{ "vor", "V,W,Xe", RSP },
+	{ "vnor", "V,W,Xe", RSP },
+	{ "vxor", "V,W,Xe", RSP },
+	{ "vnxor", "V,W,Xe", RSP },
+	{},
+	{},
+	{ "vrcp", "Vx,Xe", RSP },
+	{ "vrcpl", "Vx,Xe", RSP },
+	{ "vrcph", "Vx,Xe", RSP },
+	{ "vmov", "Vx,Xe", RSP },
+	{ "vrsq", "Vx,Xe", RSP },
+	{ "vrsql", "Vx,Xe", RSP },
+	{ "vrsqh", "Vx,Xe", RSP },
+	{ "vnop", "", RSP },
+};
+
+/* LWC2 and SWC2, by the rd field, and their offset scales */
+static const char *const vectorLoads[16] = {
+	"lbv", "lsv", "llv", "ldv", "lqv", "lrv", "lpv", "luv",
+	"lhv", "lfv", nullptr, "ltv",
+};
+static const char *const vectorStores[16] = {
+	"sbv", "ssv", "slv", "sdv", "sqv", "srv", "spv", "suv",
+	"shv", "sfv", "swv", "stv",
+};
+static const uint8_t vectorShift[16] = {
+	0, 1, 2, 3, 4, 4, 3, 3, 4, 4, 4, 4,
+};
+
+static const char *const gprNames[32] = {
+	"zero", "at", "v0", "v1", "a0", "a1", "a2", "a3",
+	"t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7",
+	"s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7",
+	"t8", "t9", "k0", "k1", "gp", "sp", "fp", "ra",
+};
+
+static const char *const cop0Names[32] = {
+	"Index", "Random", "EntryLo0", "EntryLo1",
+	"Context", "PageMask", "Wired", "$7",
+	"BadVAddr", "Count", "EntryHi", "Compare",
+	"Status", "Cause", "EPC", "PRId",
+	"Config", "LLAddr", "WatchLo", "WatchHi",
+	"XContext", "$21", "$22", "$23",
+	"$24", "$25", "ParityError", "CacheErr",
+	"TagLo", "TagHi", "ErrorEPC", "$31",
+};
+
+/* The RSP's COP0 registers are the SP and DP command registers */
+static const char *const rspCOP0Names[32] = {
+	"SP_MEM_ADDR", "SP_DRAM_ADDR", "SP_RD_LEN", "SP_WR_LEN",
+	"SP_STATUS", "SP_DMA_FULL", "SP_DMA_BUSY", "SP_SEMAPHORE",
+	"DPC_START", "DPC_END", "DPC_CURRENT", "DPC_STATUS",
+	"DPC_CLOCK", "DPC_BUFBUSY", "DPC_PIPEBUSY", "DPC_TMEM",
+	"$16", "$17", "$18", "$19", "$20", "$21", "$22", "$23",
+	"$24", "$25", "$26", "$27", "$28", "$29", "$30", "$31",
+};
+
+static const char *const cop2ControlNames[4] = {
+	"vco", "vcc", "vce", "$3",
+};
+
+static const char *const elementNames[16] = {
+	"", "", "[0q]", "[1q]", "[0h]", "[1h]", "[2h]", "[3h]",
+	"[0]", "[1]", "[2]", "[3]", "[4]", "[5]", "[6]", "[7]",
+};
+
+static const char *const accumulatorNames[16] = {
+	"$8", "$9", "$10", "$11", "$12", "$13", "$14", "$15",
+	"acc_h", "acc_m", "acc_l", "$11", "$12", "$13", "$14", "$15",
+};
+
+/* The text being formatted; len keeps counting once buf is full. */
+struct Text {
+	char *buf;
+	size_t size;
+	size_t len;
+};
+
+static inline void
+put(Text &t, char c)
+{
+	if (t.len + 1 < t.size) {
+		t.buf[t.len] = c;
+	}
+	t.len++;
+}
+
+static inline void
+put(Text &t, const char *s)
+{
+	while (*s) {
+		put(t, *s++);
+	}
+}
+
+static void
+putHex(Text &t, uint64_t v, int digits = 1)
+{
+	char tmp[16];
+	int n = 0;
+
+	do {
+		tmp[n++] = "0123456789abcdef"[v & 15];
+		v >>= 4;
+	} while (v || n < digits);
+	put(t, "0x");
+	while (n) {
+		put(t, tmp[--n]);
+	}
+}
+
+static void
+putSignedHex(Text &t, int64_t v)
+{
+	if (v < 0) {
+		put(t, '-');
+		putHex(t, -(uint64_t)v);
+	} else {
+		putHex(t, v);
+	}
+}
+
+static void
+putDecimal(Text &t, unsigned v)
+{
+	char tmp[10];
+	int n = 0;
+
+	do {
+		tmp[n++] = '0' + v % 10;
+		v /= 10;
+	} while (v);
+	while (n) {
+		put(t, tmp[--n]);
+	}
+}
+
+/* A code address: 32 bits if it is a sign-extended 32-bit one */
+static void
+putAddress(Text &t, uint64_t addr, bool rsp)
+{
+	if (rsp) {
+		putHex(t, addr & 0xfff, 3);
+	} else if ((uint64_t)(int64_t)(int32_t)addr == addr) {
+		putHex(t, (uint32_t)addr, 8);
+	} else {
+		putHex(t, addr, 16);
+	}
+}
+
+static void
+operands(Text &t, const char *ops, uint32_t opcode, uint64_t pc, bool rsp)
+{
+	uint32_t rs = bitField<21, 5>(opcode);
+	uint32_t rt = bitField<16, 5>(opcode);
+	uint32_t rd = bitField<11, 5>(opcode);
+	uint32_t sa = bitField<6, 5>(opcode);
+	int64_t imm = signExtend<16>(opcode);
+
+	for (; *ops; ops++) {
+		switch (*ops) {
+		case ',': put(t, ", "); break;
+		case 'd': put(t, gprNames[rd]); break;
+		case 's': put(t, gprNames[rs]); break;
+		case 't': put(t, gprNames[rt]); break;
+		case 'a': putDecimal(t, sa); break;
+		case 'i': putSignedHex(t, imm); break;
+		case 'u': putHex(t, bitField<0, 16>(opcode)); break;
+		case 'b':
+			putAddress(t, pc + 4 + (uint64_t)(imm << 2), rsp);
+			break;
+		case 'j':
+			putAddress(t, ((pc + 4) & ~0x0fffffffull) |
+					      bitField<0, 26>(opcode) << 2,
+				   rsp);
+			break;
+		case 'o':
+			putSignedHex(t, imm);
+			put(t, '(');
+			put(t, gprNames[rs]);
+			put(t, ')');
+			break;
+		case 'k': putHex(t, rt); break;
+		case 'D': put(t, "$f"); putDecimal(t, sa); break;
+		case 'S': put(t, "$f"); putDecimal(t, rd); break;
+		case 'T': put(t, "$f"); putDecimal(t, rt); break;
+		case 'c': put(t, '$'); putDecimal(t, rd); break;
+		case '0': put(t, (rsp ? rspCOP0Names : cop0Names)[rd]); break;
+		case '2': put(t, cop2ControlNames[rd & 3]); break;
+		case 'V': put(t, "$v"); putDecimal(t, sa); break;
+		case 'W': put(t, "$v"); putDecimal(t, rd); break;
+		case 'X': put(t, "$v"); putDecimal(t, rt); break;
+		case 'e': put(t, elementNames[rs & 15]); break;
+		case 'E':
+			put(t, '[');
+			putDecimal(t, bitField<7, 4>(opcode));
+			put(t, ']');
+			break;
+		case 'x':
+			put(t, '[');
+			putDecimal(t, rd & 7);
+			put(t, ']');
+			break;
+		case 'A': put(t, accumulatorNames[rs & 15]); break;
+		case 'O': {
+			/* A 7-bit offset in units of the access size */
+			int64_t offset = signExtend<7>(opcode);
+			putSignedHex(t, offset * (1 << vectorShift[rd & 15]));
+			put(t, '(');
+			put(t, gprNames[rs]);
+			put(t, ')');
+			break;
+		}
+		}
+	}
+}
+
+static void
+instruction(Text &t, const char *name, const char *suffix, const char *ops,
+	    uint32_t opcode, uint64_t pc, bool rsp)
+{
+	size_t start = t.len;
+
+	put(t, name);
+	put(t, suffix);
+	if (*ops) {
+		do {
+			put(t, ' ');
+		} while (t.len - start < 8);
+		operands(t, ops, opcode, pc, rsp);
+	}
+}
+
+static void
+unknown(Text &t, uint32_t opcode)
+{
+	put(t, ".word   ");
+	putHex(t, opcode, 8);
+}
+
+static void
+disassemble(Text &t, uint32_t opcode, uint64_t pc, bool rsp)
+{
+	uint8_t core = rsp ? RSP : CPU;
+	uint32_t rs = bitField<21, 5>(opcode);
+	uint32_t rt = bitField<16, 5>(opcode);
+	uint32_t rd = bitField<11, 5>(opcode);
+	const Op *op = nullptr;
+	const char *suffix = "";
+
+	if (opcode == 0) {
+		put(t, "nop");
+		return;
+	}
+
+	switch (bitField<26, 6>(opcode)) {
+	case 0b000000: op = &special[opcode & 63]; break;
+	case 0b000001: op = &regimm[rt]; break;
+	case 0b010000:
+		if (rs == 16 && !rsp) {
+			static const Op tlb[] = {
+				{ "tlbr", "", CPU },
+				{ "tlbwi", "", CPU },
+				{ "tlbwr", "", CPU },
+				{ "tlbp", "", CPU },
+				{ "eret", "", CPU },
+			};
+			switch (opcode & 63) {
+			case 1: op = &tlb[0]; break;
+			case 2: op = &tlb[1]; break;
+			case 6: op = &tlb[2]; break;
+			case 8: op = &tlb[3]; break;
+			case 24: op = &tlb[4]; break;
+			}
+		} else {
+			static const Op moves[] = {
+				{ "mfc0", "t,0", Both },
+				{ "dmfc0", "t,0", CPU },
+				{ "mtc0", "t,0", Both },
+				{ "dmtc0", "t,0", CPU },
+			};
+			switch (rs) {
+			case 0: op = &moves[0]; break;
+			case 1: op = &moves[1]; break;
+			case 4: op = &moves[2]; break;
+			case 5: op = &moves[3]; break;
+			}
+		}
+		break;
+	case 0b010001: {
+		static const Op moves[] = {
+			{ "mfc1", "t,S", CPU },
+			{ "dmfc1", "t,S", CPU },
+			{ "cfc1", "t,c", CPU },
+			{ "mtc1", "t,S", CPU },
+			{ "dmtc1", "t,S", CPU },
+			{ "ctc1", "t,c", CPU },
+			{ "bc1f", "b", CPU },
+			{ "bc1t", "b", CPU },
+			{ "bc1fl", "b", CPU },
+			{ "bc1tl", "b", CPU },
+		};
+		switch (rs) {
+		case 0: op = &moves[0]; break;
+		case 1: op = &moves[1]; break;
+		case 2: op = &moves[2]; break;
+		case 4: op = &moves[3]; break;
+		case 5: op = &moves[4]; break;
+		case 6: op = &moves[5]; break;
+		case 8: op = &moves[6 + (rt & 3)]; break;
+		case 16: op = &cop1[opcode & 63], suffix = ".s"; break;
+		case 17: op = &cop1[opcode & 63], suffix = ".d"; break;
+		case 20: op = &cop1[opcode & 63], suffix = ".w"; break;
+		case 21: op = &cop1[opcode & 63], suffix = ".l"; break;
+		}
+		break;
+	}
+	case 0b010010:
+		if (rs & 16) {
+			op = &vector[opcode & 63];
+		} else {
+			static const Op moves[] = {
+				{ "mfc2", "t,WE", RSP },
+				{ "cfc2", "t,2", RSP },
+				{ "mtc2", "t,WE", RSP },
+				{ "ctc2", "t,2", RSP },
+			};
+			switch (rs) {
+			case 0: op = &moves[0]; break;
+			case 2: op = &moves[1]; break;
+			case 4: op = &moves[2]; break;
+			case 6: op = &moves[3]; break;
+			}
+		}
+		break;
+	case 0b110010:
+	case 0b111010: {
+		bool store = opcode >> 29 & 1;
+		const char *name = (store ? vectorStores : vectorLoads)[rd & 15];
+		if (!rsp || rd > 15 || !name) {
+			break;
+		}
+		instruction(t, name, "", "XE,O", opcode, pc, rsp);
+		return;
+	}
+	default: op = &primary[bitField<26, 6>(opcode)]; break;
+	}
+
+	if (!op || !op->name || !(op->cores & core)) {
+		unknown(t, opcode);
+		return;
+	}
+	instruction(t, op->name, suffix, op->operands, opcode, pc, rsp);
+}
+
+static size_t
+finish(Text &t)
+{
+	if (t.size) {
+		t.buf[t.len < t.size ? t.len : t.size - 1] = '\0';
+	}
+	return t.len;
+}
+
+size_t
+disassembleVR4300(uint32_t opcode, uint64_t pc, char *buf, size_t size)
+{
+	Text t = { buf, size, 0 };
+
+	disassemble(t, opcode, pc, false);
+	return finish(t);
+}
+
+size_t
+disassembleRSP(uint32_t opcode, uint32_t pc, char *buf, size_t size)
+{
+	Text t = { buf, size, 0 };
+
+	disassemble(t, opcode, pc, true);
+	return finish(t);
+}
+
+const char *
+gprName(int r)
+{
+	return gprNames[r & 31];
+}
+
+const char *
+cop0Name(int r)
+{
+	return cop0Names[r & 31];
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Disassembly of VR4300 and RSP instructions, scalar and vector, with
+ * operands and resolved branch targets, e.g.
+ *
+ *	addiu   sp, sp, -0x20
+ *	beq     a0, zero, 0x80001234
+ *	vmadh   $v1, $v2, $v3[2h]
+ *
+ * Both functions are reentrant and write into the caller's buffer
+ * without allocating. Like snprintf they return the length of the full
+ * text and always terminate buf if size is non-zero; 64 bytes is enough
+ * for any instruction.
+ */
+
+static const size_t disasmMaxLength = 64;
+
+/* Format opcode, fetched from pc, as a VR4300 instruction. */
+extern size_t
+disassembleVR4300(uint32_t opcode, uint64_t pc, char *buf, size_t size);
+
+/* Format opcode, fetched from IMEM offset pc, as an RSP instruction. */
+extern size_t
+disassembleRSP(uint32_t opcode, uint32_t pc, char *buf, size_t size);
+
+/* Names of general purpose registers (ABI) and VR4300 COP0 registers. */
+extern const char *
+gprName(int r);
+
+extern const char *
+cop0Name(int r);
@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <new>
+
+#include "emulator.h"
+#include "fpu.h"
+#include "savestate.h"
+
+static const uint64_t sliceCycles = 3 * 1024;
+
+/* Five minutes of frames, with a keyframe every second */
+static const size_t rewindFrames = 5 * 60 * 60;
+static const int rewindKeyframeInterval = 60;
+
+thread_local Emulator *emu;
+
+/* The thread's FPU modes from before it bound its first instance */
+static thread_local uint32_t hostFPU;
+
+/* Binds an instance for the lifetime of the guard. */
+struct Binding {
+	Emulator *previous;
+
+	Binding(Emulator *e) : previous(emulatorBind(e)) {}
+	~Binding() { emulatorBind(previous); }
+};
+
+Emulator *
+emulatorBind(Emulator *e)
+{
+	Emulator *previous = emu;
+
+	if (previous) {
+		fpuUnbind();
+	} else if (e) {
+		hostFPU = fpuHostState();
+	}
+
+	emu = e;
+	reg = e ? &e->reg : nullptr;
+	rcp = e ? &e->rcp : nullptr;
+	sp = e ? &e->sp : nullptr;
+	mem = e ? &e->mem : nullptr;
+	mi = e ? &e->mi : nullptr;
+	pif = e ? &e->pif : nullptr;
+	sched = e ? &e->sched : nullptr;
+
+	/* The host FPU modes are per thread, so load this instance's. */
+	if (e) {
+		fpuBind();
+	} else if (previous) {
+		fpuSetHostState(hostFPU);
+	}
+	return previous;
+}
+
+Emulator *
+emulatorCreate(const CPUOptions &options)
+{
+	size_t decodedSize = rdramPages * decodedPerPage * sizeof(Decoded);
+	Arena arena;
+
+	if (!arenaCreate(arena, 2 * rdramSize + sizeof(Emulator) +
+					decodedSize + 4096)) {
+		return nullptr;
+	}
+	/* RDRAM first, so the Expansion Pak half is whole huge pages. */
+	uint8_t *rdram = (uint8_t *)arenaAlloc(arena, rdramSize, arenaPageSize);
+	uint8_t *guestOrder =
+		(uint8_t *)arenaAlloc(arena, rdramSize, arenaPageSize);
+	void *p = arenaAlloc(arena, sizeof(Emulator), alignof(Emulator));
+	Decoded *decoded = (Decoded *)arenaAlloc(arena, decodedSize, 4096);
+	if (!rdram || !guestOrder || !p || !decoded) {
+		arenaDestroy(arena);
+		return nullptr;
+	}
+
+	Emulator *e = new (p) Emulator();
+	e->arena = arena;
+	e->mem.mem = rdram;
+	e->mem.guestOrder = guestOrder;
+	e->vr4300.decoded = decoded;
+
+	Binding b(e);
+
+	rdramSetExpansionPak(false);
+
+	schedulerReset();
+	viReset();
+	cpuReset();
+	rspReset();
+	cpuConfigure(options);
+	return e;
+}
+
+void
+emulatorDestroy(Emulator *e)
+{
+	{
+		Binding b(e);
+
+		movieStop();
+		stateHashLogOpen(nullptr);
+		traceClose();
+	}
+
+	Arena arena = e->arena;
+	e->~Emulator();
+	arenaDestroy(arena);
+}
+
+void
+emulatorRun(Emulator *e, uint64_t cycles)
+{
+	Binding b(e);
+
+	uint64_t end = sched->cycles + cycles;
+	while (sched->cycles < end && !emu->debug.stopped) {
+		runCPU(sched->cycles + sliceCycles);
+		runRSP(sliceCycles * 2 / 3);
+	}
+}
+
+void
+emulatorSetRewind(Emulator *e, size_t bytes)
+{
+	Binding b(e);
+
+	if (!bytes) {
+		e->rewind = RewindBuffer();
+		return;
+	}
+	rewindInit(e->rewind, bytes, rewindFrames, rewindKeyframeInterval);
+}
+
+void
+emulatorFrame(Emulator *e)
+{
+	emulatorRun(e, viFrameCycles);
+
+	/* A stopped instance did not run; don't fill history with copies */
+	if (!e->rewind.entries.empty() && !e->debug.stopped) {
+		Binding b(e);
+
+		rewindPush(e->rewind);
+	}
+}
+
+bool
+emulatorRewind(Emulator *e)
+{
+	Binding b(e);
+
+	if (movieMode() != MovieOff) {
+		return false;
+	}
+	return rewindPop(e->rewind);
+}
+
+size_t
+emulatorSnapshotBound(Emulator *e)
+{
+	Binding b(e);
+
+	return saveStateBound();
+}
+
+size_t
+emulatorSnapshot(Emulator *e, uint8_t *buf, size_t capacity)
+{
+	Binding b(e);
+
+	return saveState(buf, capacity);
+}
+
+bool
+emulatorRestore(Emulator *e, const uint8_t *buf, size_t size)
+{
+	Binding b(e);
+
+	return loadState(buf, size);
+}
+
+uint64_t
+emulatorStateHash(Emulator *e)
+{
+	Binding b(e);
+
+	return stateHash();
+}
@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "arena.h"
+#include "cpu.h"
+#include "debugger.h"
+#include "frameskip.h"
+#include "idle.h"
+#include "inspector.h"
+#include "mem.h"
+#include "mi.h"
+#include "mips.h"
+#include "movie.h"
+#include "pif.h"
+#include "rcp.h"
+#include "rewind.h"
+#include "scheduler.h"
+#include "statehash.h"
+#include "vi.h"
+
+/*
+ * All the state of one emulated machine. Any number of instances can
+ * exist and run concurrently on different threads.
+ *
+ * The subsystems reach their state through thread-local pointers (reg,
+ * mem, sched, ... and emu for everything else), so the interpreter's
+ * hot paths keep addressing a single object instead of threading a
+ * context argument through every handler and bus access. Binding an
+ * instance points them all at it; each thread has its own binding, and
+ * an instance must only be bound on one thread at a time.
+ *
+ * The emulator* functions below bind the given instance for the duration
+ * of the call, so they can be used from any thread without managing the
+ * binding by hand. Host input devices are shared by all instances.
+ *
+ * An instance and its fixed-size state, down to the decoded instruction
+ * caches, live in one arena (see arena.h). The exceptions are buffers
+ * whose size is up to the user: a movie being played back, the rewind
+ * history and the debugger's breakpoint and watchpoint lists are
+ * std::vectors on the heap, as is the ring of an open trace. They are only touched by
+ * whoever has the instance bound and are freed by emulatorDestroy(), so
+ * instances still share no state.
+ */
+struct Emulator {
+	Arena arena;
+	Registers reg;
+	Registers rcp;
+	SPMemory sp;
+	Memory mem;
+	MIRegisters mi;
+	VIState vi;
+	PIF pif;
+	Scheduler sched;
+	VR4300State vr4300;
+	RSPState rsp;
+	IdleCache idle;
+	StateHash hash;
+	TraceState trace;
+	MovieState movie;
+	RewindBuffer rewind;
+	DebugState debug;
+	InspectState inspect;
+	FrameskipState frameskip;
+};
+
+extern thread_local Emulator *emu;
+
+/*
+ * A machine fresh out of reset, configured with options. Returns null if
+ * its arena cannot be mapped.
+ */
+extern Emulator *
+emulatorCreate(const CPUOptions &options = CPUOptions());
+
+/* Stop any movie, hash log and trace of e, then unmap it. */
+extern void
+emulatorDestroy(Emulator *e);
+
+/*
+ * Make e the current instance of the calling thread, and return the
+ * previous one. Null unbinds. The thread's FPU modes follow the binding:
+ * the previous instance keeps the FPU flags it raised, e starts with
+ * none, and unbinding restores the modes the thread had before.
+ */
+extern Emulator *
+emulatorBind(Emulator *e);
+
+/*
+ * Run e for at least cycles CPU cycles, with the RSP at 2/3 speed. Returns
+ * early if the debugger stops it (see debugger.h).
+ */
+extern void
+emulatorRun(Emulator *e, uint64_t cycles);
+
+/*
+ * Keep up to bytes of rewind history for e, which emulatorFrame() adds
+ * to once per frame. Zero frees the history.
+ */
+extern void
+emulatorSetRewind(Emulator *e, size_t bytes);
+
+/* Run e for one frame, then record it in the rewind history, if any. */
+extern void
+emulatorFrame(Emulator *e);
+
+/*
+ * Restore e to the most recent frame in its rewind history and drop it
+ * from there. Returns false if there is none, or while a movie is being
+ * recorded or played back, which rewinding would invalidate.
+ */
+extern bool
+emulatorRewind(Emulator *e);
+
+/* Upper bound on the size of a snapshot of e. */
+extern size_t
+emulatorSnapshotBound(Emulator *e);
+
+/* As saveState() and loadState(), for e. */
+extern size_t
+emulatorSnapshot(Emulator *e, uint8_t *buf, size_t capacity);
+
+extern bool
+emulatorRestore(Emulator *e, const uint8_t *buf, size_t size);
+
+/* As stateHash(), for e. */
+extern uint64_t
+emulatorStateHash(Emulator *e);
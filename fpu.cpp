@@ -0,0 +1,630 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#else
+#include <cfenv>
+#endif
+
+#include "bits.h"
+#include "fpu.h"
+
+static const uint32_t fcr0Revision = 0x00000a00;
+
+/* FCR31 rounding modes: nearest, zero, +infinity, -infinity. */
+enum Rounding {
+	RoundNearest,
+	RoundZero,
+	RoundUp,
+	RoundDown,
+};
+
+#if defined(__SSE2__)
+static const uint32_t mxcsrRounding[4] = { 0x0000, 0x6000, 0x4000, 0x2000 };
+static const uint32_t mxcsrRoundingMask = 0x6000;
+static const uint32_t mxcsrFlushToZero = 0x8000;
+static const uint32_t mxcsrFlags = 0x3f;
+
+/* MXCSR flags in FCR31 order: inexact, underflow, overflow, zero, invalid. */
+static inline uint32_t
+hostFlags()
+{
+	uint32_t m = _mm_getcsr();
+	return (m >> 5 & 1) | (m >> 4 & 1) << 1 | (m >> 3 & 1) << 2 |
+	       (m >> 2 & 1) << 3 | (m & 1) << 4;
+}
+
+static inline void
+hostClearFlags()
+{
+	_mm_setcsr(_mm_getcsr() & ~mxcsrFlags);
+}
+
+static inline uint32_t
+hostRounding()
+{
+	return _mm_getcsr() & mxcsrRoundingMask;
+}
+
+static inline void
+hostSetRounding(uint32_t mode)
+{
+	_mm_setcsr((_mm_getcsr() & ~mxcsrRoundingMask) | mode);
+}
+
+void
+fpuSyncHost()
+{
+	uint32_t m = _mm_getcsr() & ~(mxcsrRoundingMask | mxcsrFlushToZero);
+	m |= mxcsrRounding[reg->fcr31 & 3];
+	if (reg->fcr31 & fcr31FlushSubnormals) {
+		m |= mxcsrFlushToZero;
+	}
+	_mm_setcsr(m);
+}
+
+uint32_t
+fpuHostState()
+{
+	return _mm_getcsr();
+}
+
+void
+fpuSetHostState(uint32_t state)
+{
+	_mm_setcsr(state);
+}
+
+/* Convert using the current host rounding mode. */
+static inline int64_t
+hostToInt(float v, bool wide)
+{
+	__m128 x = _mm_set_ss(v);
+	return wide ? _mm_cvtss_si64(x) : _mm_cvtss_si32(x);
+}
+
+static inline int64_t
+hostToInt(double v, bool wide)
+{
+	__m128d x = _mm_set_sd(v);
+	return wide ? _mm_cvtsd_si64(x) : _mm_cvtsd_si32(x);
+}
+#else
+static const int fenvRounding[4] = { FE_TONEAREST, FE_TOWARDZERO, FE_UPWARD,
+				     FE_DOWNWARD };
+
+static inline uint32_t
+hostFlags()
+{
+	int e = fetestexcept(FE_ALL_EXCEPT);
+	return !!(e & FE_INEXACT) | !!(e & FE_UNDERFLOW) << 1 |
+	       !!(e & FE_OVERFLOW) << 2 | !!(e & FE_DIVBYZERO) << 3 |
+	       !!(e & FE_INVALID) << 4;
+}
+
+static inline void
+hostClearFlags()
+{
+	feclearexcept(FE_ALL_EXCEPT);
+}
+
+static inline uint32_t
+hostRounding()
+{
+	return fegetround();
+}
+
+static inline void
+hostSetRounding(uint32_t mode)
+{
+	fesetround(mode);
+}
+
+void
+fpuSyncHost()
+{
+	fesetround(fenvRounding[reg->fcr31 & 3]);
+}
+
+uint32_t
+fpuHostState()
+{
+	return fegetround();
+}
+
+void
+fpuSetHostState(uint32_t state)
+{
+	fesetround(state);
+	feclearexcept(FE_ALL_EXCEPT);
+}
+
+template <typename T>
+static inline int64_t
+hostToInt(T v, bool wide)
+{
+	if (wide) {
+		return llrint(v);
+	}
+	long r = lrint(v);
+	return (r < INT32_MIN || r > INT32_MAX) ? INT32_MIN : r;
+}
+#endif
+
+/* Keep the compiler from moving FP work across MXCSR accesses. */
+template <typename T>
+static inline void
+barrier(T &v)
+{
+	asm volatile("" : "+m"(v));
+}
+
+static inline void
+foldFlags()
+{
+	reg->fcr31 |= hostFlags() << fcr31FlagShift;
+	hostClearFlags();
+}
+
+static inline uint32_t
+enabledTraps()
+{
+	return (reg->fcr31 >> fcr31EnableShift) & fpuExceptionMask;
+}
+
+static void
+setCause(uint32_t cause)
+{
+	reg->fcr31 = (reg->fcr31 & ~(0x3f << fcr31CauseShift)) |
+		    cause << fcr31CauseShift;
+}
+
+/* Unimplemented operation always traps, whatever the enables say. */
+static void
+unimplemented()
+{
+	setCause(0);
+	reg->fcr31 |= fcr31CauseE;
+	cpuException(ExcFloatingPoint);
+}
+
+/*
+ * Slow path, taken only when the guest enabled a trap: run op with clean
+ * flags so its exceptions can be told apart from earlier ones. Returns
+ * false if the op trapped, in which case nothing may be written back.
+ */
+template <typename Out, typename Op>
+static inline bool
+checked(Out &v, Op op)
+{
+	uint32_t enables = enabledTraps();
+
+	foldFlags();
+	v = op();
+	barrier(v);
+	uint32_t cause = hostFlags();
+	hostClearFlags();
+
+	setCause(cause);
+	if (cause & enables) {
+		cpuException(ExcFloatingPoint);
+		return false;
+	}
+	reg->fcr31 |= cause << fcr31FlagShift;
+	return true;
+}
+
+template <typename T>
+static inline T
+getF(int n);
+
+template <>
+inline float
+getF<float>(int n)
+{
+	uint32_t bits = fgr32(n);
+	float v;
+	memcpy(&v, &bits, sizeof(v));
+	return v;
+}
+
+template <>
+inline double
+getF<double>(int n)
+{
+	uint64_t bits = fgr64(n);
+	double v;
+	memcpy(&v, &bits, sizeof(v));
+	return v;
+}
+
+template <>
+inline int32_t
+getF<int32_t>(int n)
+{
+	return (int32_t)fgr32(n);
+}
+
+template <>
+inline int64_t
+getF<int64_t>(int n)
+{
+	return (int64_t)fgr64(n);
+}
+
+static inline void
+setF(int n, float v)
+{
+	uint32_t bits;
+	memcpy(&bits, &v, sizeof(bits));
+	setFgr32(n, bits);
+}
+
+static inline void
+setF(int n, double v)
+{
+	uint64_t bits;
+	memcpy(&bits, &v, sizeof(bits));
+	setFgr64(n, bits);
+}
+
+static inline void
+setF(int n, int32_t v)
+{
+	setFgr32(n, (uint32_t)v);
+}
+
+static inline void
+setF(int n, int64_t v)
+{
+	setFgr64(n, (uint64_t)v);
+}
+
+template <typename Out, typename In, typename Op>
+static inline void
+unary(int fd, In a, Op op)
+{
+	if (!enabledTraps()) {
+		setF(fd, (Out)op(a));
+		return;
+	}
+	Out v;
+	if (checked(v, [&] {
+		    barrier(a);
+		    return (Out)op(a);
+	    })) {
+		setF(fd, v);
+	}
+}
+
+template <typename T, typename Op>
+static inline void
+binary(int fd, T a, T b, Op op)
+{
+	if (!enabledTraps()) {
+		setF(fd, op(a, b));
+		return;
+	}
+	T v;
+	if (checked(v, [&] {
+		    barrier(a);
+		    barrier(b);
+		    return op(a, b);
+	    })) {
+		setF(fd, v);
+	}
+}
+
+template <typename T>
+static inline T
+hostSqrt(T v);
+
+template <>
+inline float
+hostSqrt<float>(float v)
+{
+#if defined(__SSE2__)
+	return _mm_cvtss_f32(_mm_sqrt_ss(_mm_set_ss(v)));
+#else
+	return sqrtf(v);
+#endif
+}
+
+template <>
+inline double
+hostSqrt<double>(double v)
+{
+#if defined(__SSE2__)
+	__m128d x = _mm_set_sd(v);
+	return _mm_cvtsd_f64(_mm_sqrt_sd(x, x));
+#else
+	return sqrt(v);
+#endif
+}
+
+/*
+ * Float to integer conversion in the given rounding mode, or the current
+ * one if mode is negative. Out of range and NaN inputs produce the host's
+ * "integer indefinite" value, which the VR4300 reports as an unimplemented
+ * operation instead.
+ */
+template <typename I, typename T>
+static void
+toInt(int fd, T a, int mode)
+{
+	const bool wide = sizeof(I) == 8;
+	const int64_t indefinite = wide ? INT64_MIN : INT32_MIN;
+	uint32_t saved = 0;
+
+#if defined(__SSE2__)
+	if (mode >= 0) {
+		saved = hostRounding();
+		hostSetRounding(mxcsrRounding[mode]);
+	}
+#else
+	if (mode >= 0) {
+		saved = hostRounding();
+		hostSetRounding(fenvRounding[mode]);
+	}
+#endif
+
+	int64_t v = 0;
+	bool ok = true;
+	if (!enabledTraps()) {
+		v = hostToInt(a, wide);
+	} else {
+		ok = checked(v, [&] {
+			barrier(a);
+			return hostToInt(a, wide);
+		});
+	}
+
+	if (mode >= 0) {
+		hostSetRounding(saved);
+	}
+	if (!ok) {
+		return;
+	}
+	if (v == indefinite && a != (T)indefinite) {
+		unimplemented();
+		return;
+	}
+	setF(fd, (I)v);
+}
+
+template <typename T>
+static void
+compare(uint32_t cond, T a, T b)
+{
+	bool unordered = std::isnan(a) || std::isnan(b);
+	bool c = ((cond & 4) && !unordered && a < b) ||
+		 ((cond & 2) && !unordered && a == b) ||
+		 ((cond & 1) && unordered);
+
+	/* The signalling predicates treat any NaN as invalid. */
+	if (unordered && (cond & 8)) {
+		const uint32_t invalid = 1 << 4;
+		if (enabledTraps() & invalid) {
+			setCause(invalid);
+			cpuException(ExcFloatingPoint);
+			return;
+		}
+		reg->fcr31 |= invalid << fcr31FlagShift;
+	}
+
+	if (c) {
+		reg->fcr31 |= fcr31Condition;
+	} else {
+		reg->fcr31 &= ~fcr31Condition;
+	}
+}
+
+/* Conversions shared by every source format. */
+template <typename T>
+static bool
+convert(uint32_t funct, int fd, T a)
+{
+	switch (funct) {
+	case 0b100000: /* CVT.S */
+		unary<float>(fd, a, [](T x) { return x; });
+		return true;
+	case 0b100001: /* CVT.D */
+		unary<double>(fd, a, [](T x) { return x; });
+		return true;
+	default:
+		return false;
+	}
+}
+
+template <typename T>
+static void
+arith(uint32_t funct, int fd, int fs, int ft)
+{
+	T a = getF<T>(fs);
+	T b = getF<T>(ft);
+
+	switch (funct) {
+	case 0b000000: /* ADD */
+		binary(fd, a, b, [](T x, T y) { return x + y; });
+		break;
+	case 0b000001: /* SUB */
+		binary(fd, a, b, [](T x, T y) { return x - y; });
+		break;
+	case 0b000010: /* MUL */
+		binary(fd, a, b, [](T x, T y) { return x * y; });
+		break;
+	case 0b000011: /* DIV */
+		binary(fd, a, b, [](T x, T y) { return x / y; });
+		break;
+	case 0b000100: /* SQRT */
+		unary<T>(fd, a, [](T x) { return hostSqrt(x); });
+		break;
+	case 0b000101: /* ABS */
+		unary<T>(fd, a, [](T x) { return std::fabs(x); });
+		break;
+	case 0b000110: /* MOV */
+		setF(fd, a);
+		break;
+	case 0b000111: /* NEG */
+		unary<T>(fd, a, [](T x) { return -x; });
+		break;
+	case 0b001000: /* ROUND.L */
+		toInt<int64_t>(fd, a, RoundNearest);
+		break;
+	case 0b001001: /* TRUNC.L */
+		toInt<int64_t>(fd, a, RoundZero);
+		break;
+	case 0b001010: /* CEIL.L */
+		toInt<int64_t>(fd, a, RoundUp);
+		break;
+	case 0b001011: /* FLOOR.L */
+		toInt<int64_t>(fd, a, RoundDown);
+		break;
+	case 0b001100: /* ROUND.W */
+		toInt<int32_t>(fd, a, RoundNearest);
+		break;
+	case 0b001101: /* TRUNC.W */
+		toInt<int32_t>(fd, a, RoundZero);
+		break;
+	case 0b001110: /* CEIL.W */
+		toInt<int32_t>(fd, a, RoundUp);
+		break;
+	case 0b001111: /* FLOOR.W */
+		toInt<int32_t>(fd, a, RoundDown);
+		break;
+	case 0b100100: /* CVT.W */
+		toInt<int32_t>(fd, a, -1);
+		break;
+	case 0b100101: /* CVT.L */
+		toInt<int64_t>(fd, a, -1);
+		break;
+	default:
+		if (funct >= 0b110000) { /* C.cond */
+			compare(funct & 0xf, a, b);
+		} else if (!convert(funct, fd, a)) {
+			unimplemented();
+		}
+		break;
+	}
+}
+
+void
+fpuBind()
+{
+	hostClearFlags();
+	fpuSyncHost();
+}
+
+void
+fpuUnbind()
+{
+	foldFlags();
+}
+
+uint32_t
+fpuReadFCR31()
+{
+	foldFlags();
+	return reg->fcr31;
+}
+
+void
+fpuWriteFCR31(uint32_t value)
+{
+	reg->fcr31 = value & fcr31Writable;
+	hostClearFlags();
+	fpuSyncHost();
+
+	/* Setting a cause bit whose trap is enabled traps immediately. */
+	uint32_t cause = (reg->fcr31 >> fcr31CauseShift) & 0x3f;
+	if (cause & (enabledTraps() | fcr31CauseE >> fcr31CauseShift)) {
+		cpuException(ExcFloatingPoint);
+	}
+}
+
+void
+execCOP1(uint32_t opcode)
+{
+	uint8_t fmt = bitField<21, 5>(opcode);
+	uint8_t rt = bitField<16, 5>(opcode);
+	uint8_t fs = bitField<11, 5>(opcode);
+	uint8_t fd = bitField<6, 5>(opcode);
+	uint8_t funct = bitField<0, 6>(opcode);
+
+	if (!fpuUsable()) {
+		return;
+	}
+
+	switch (fmt) {
+	case 0b00000: /* MFC1 */
+		reg->gpr[rt] = (int32_t)fgr32(fs);
+		break;
+	case 0b00001: /* DMFC1 */
+		reg->gpr[rt] = fgr64(fs);
+		break;
+	case 0b00010: /* CFC1 */
+		if (fs == 0) {
+			reg->gpr[rt] = fcr0Revision;
+		} else if (fs == 31) {
+			reg->gpr[rt] = (int32_t)fpuReadFCR31();
+		}
+		break;
+	case 0b00100: /* MTC1 */
+		setFgr32(fs, (uint32_t)reg->gpr[rt]);
+		break;
+	case 0b00101: /* DMTC1 */
+		setFgr64(fs, reg->gpr[rt]);
+		break;
+	case 0b00110: /* CTC1 */
+		if (fs == 31) {
+			fpuWriteFCR31((uint32_t)reg->gpr[rt]);
+		}
+		break;
+	case 0b10000: /* S */
+		arith<float>(funct, fd, fs, rt);
+		break;
+	case 0b10001: /* D */
+		arith<double>(funct, fd, fs, rt);
+		break;
+	case 0b10100: /* W */
+		if (!convert(funct, fd, getF<int32_t>(fs))) {
+			unimplemented();
+		}
+		break;
+	case 0b10101: /* L */
+		if (!convert(funct, fd, getF<int64_t>(fs))) {
+			unimplemented();
+		}
+		break;
+	default:
+		unimplemented();
+		break;
+	}
+}
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "cpu.h"
+
+/*
+ * COP1, the VR4300 FPU.
+ *
+ * Arithmetic runs on host SSE2 scalar instructions with the guest rounding
+ * mode loaded into MXCSR, so an FPU op costs what the host op costs. The
+ * IEEE flag bits are not tracked per instruction: MXCSR accumulates them
+ * for us and they are folded into FCR31 whenever the guest reads it. Only
+ * when FCR31 has an exception enabled does an op check its flags, since
+ * only then can it trap. MXCSR is per host thread, so it follows the
+ * instance binding (see emulatorBind()): host code run while an instance
+ * is bound uses the guest's rounding mode, and code outside any binding
+ * gets the thread's own MXCSR back.
+ */
+
+static const uint32_t fcr31FlagShift = 2;
+static const uint32_t fcr31EnableShift = 7;
+static const uint32_t fcr31CauseShift = 12;
+static const uint32_t fcr31Condition = 1 << 23;
+static const uint32_t fcr31FlushSubnormals = 1 << 24;
+/* Unimplemented operation, a cause bit with no flag or enable. */
+static const uint32_t fcr31CauseE = 1 << 17;
+static const uint32_t fcr31Writable = 0x0183ffff;
+
+/* Inexact, underflow, overflow, division by zero, invalid. */
+static const uint32_t fpuExceptionMask = 0x1f;
+
+static inline bool
+fpuFR()
+{
+	return reg->cop0[COP0Status] & statusFR;
+}
+
+/*
+ * With FR clear there are sixteen 64-bit registers, and an odd register
+ * number names the upper half of the even one below it.
+ */
+static inline uint32_t
+fgr32(int n)
+{
+	if (!fpuFR() && (n & 1)) {
+		return (uint32_t)(reg->fpr[n & ~1] >> 32);
+	}
+	return (uint32_t)reg->fpr[n];
+}
+
+static inline void
+setFgr32(int n, uint32_t value)
+{
+	if (!fpuFR() && (n & 1)) {
+		uint64_t &r = reg->fpr[n & ~1];
+		r = (r & 0xffffffffull) | (uint64_t)value << 32;
+	} else {
+		uint64_t &r = reg->fpr[n];
+		r = (r & ~0xffffffffull) | value;
+	}
+}
+
+static inline uint64_t
+fgr64(int n)
+{
+	return reg->fpr[fpuFR() ? n : n & ~1];
+}
+
+static inline void
+setFgr64(int n, uint64_t value)
+{
+	reg->fpr[fpuFR() ? n : n & ~1] = value;
+}
+
+/* Raise a coprocessor unusable exception unless Status.CU1 is set. */
+static inline bool
+fpuUsable()
+{
+	if (!(reg->cop0[COP0Status] & statusCU1)) {
+		cpuException(ExcCoprocessor, 1);
+		return false;
+	}
+	return true;
+}
+
+static inline bool
+fpuCondition()
+{
+	return reg->fcr31 & fcr31Condition;
+}
+
+/*
+ * Execute a COP1 opcode: moves to and from the FPU and the arithmetic
+ * formats. BC1x branches are handled by the CPU core using fpuCondition().
+ */
+extern void
+execCOP1(uint32_t opcode);
+
+/* Load the rounding and flush modes from FCR31 into the host FPU. */
+extern void
+fpuSyncHost();
+
+/*
+ * Hand the host FPU to the bound instance, with no flags pending, or take
+ * it back, folding the flags it raised into its FCR31.
+ */
+extern void
+fpuBind();
+
+extern void
+fpuUnbind();
+
+/* The thread's own FPU modes, saved before binding and restored after. */
+extern uint32_t
+fpuHostState();
+
+extern void
+fpuSetHostState(uint32_t state);
+
+/* FCR31 as the guest sees it, with pending host flags folded in. */
+extern uint32_t
+fpuReadFCR31();
+
+extern void
+fpuWriteFCR31(uint32_t value);
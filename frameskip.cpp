@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstring>
+
+#include "cpu.h"
+#include "emulator.h"
+#include "frameskip.h"
+
+/* Stop tracking the pages of the last drawn frame. */
+static void
+clearTracking()
+{
+	for (uint8_t &consumers : emu->vr4300.watchPages) {
+		consumers &= ~WatchReadback;
+	}
+}
+
+void
+frameskipSet(unsigned interval)
+{
+	FrameskipState &fs = emu->frameskip;
+
+	fs.interval = interval;
+	fs.skipping = false;
+	fs.frame = 0;
+	fs.skipped = 0;
+	memset(fs.readback, 0, sizeof(fs.readback));
+	clearTracking();
+	if (fs.tracking) {
+		cpuWatch(false);
+		fs.tracking = false;
+	}
+}
+
+void
+frameskipFrame()
+{
+	FrameskipState &fs = emu->frameskip;
+
+	if (fs.interval <= 1) {
+		return;
+	}
+	fs.frame++;
+	fs.skipping = fs.frame % fs.interval != 0;
+	if (fs.skipping) {
+		fs.skipped++;
+	} else {
+		/* Only the targets of the latest drawn frame are tracked */
+		clearTracking();
+	}
+}
+
+bool
+frameskipDraw(uint32_t addr, uint32_t size)
+{
+	FrameskipState &fs = emu->frameskip;
+
+	if (fs.interval <= 1 || !size) {
+		return true;
+	}
+
+	uint32_t first = (addr & (rdramSize - 1)) >> rdramPageShift;
+	uint32_t last = ((addr + size - 1) & (rdramSize - 1)) >> rdramPageShift;
+	if (last < first) {
+		last = rdramPages - 1;
+	}
+	if (!fs.skipping && !fs.tracking) {
+		/* The first frame drawn into RDRAM starts the tracking */
+		cpuWatch(true);
+		fs.tracking = true;
+	}
+	for (uint32_t page = first; page <= last; page++) {
+		if (!fs.skipping) {
+			emu->vr4300.watchPages[page] |= WatchReadback;
+		} else if (fs.readback[page]) {
+			return true;
+		}
+	}
+	return !fs.skipping;
+}
+
+void
+frameskipReadback(uint32_t paddr)
+{
+	uint32_t page = paddr >> rdramPageShift;
+
+	emu->frameskip.readback[page] = true;
+	/* Learned; the page needs no more checking */
+	emu->vr4300.watchPages[page] &= ~WatchReadback;
+}
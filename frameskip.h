@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "mem.h"
+
+/*
+ * Frame skipping for turbo and replay runs. With an interval of N only
+ * one frame in N is drawn: renderers ask frameskipDraw() before
+ * rasterizing into a framebuffer and drop the work when it says no, and
+ * the VI does not scan out skipped frames.
+ *
+ * That is only safe for framebuffers nothing but the VI looks at. Games
+ * also render into buffers the CPU reads back, and those must be drawn
+ * every frame. They are found with RDRAM page tracking: the pages each
+ * drawn frame renders into are marked WatchReadback (see cpuWatch()),
+ * and a CPU load from one marks the page as read back for good, so
+ * frameskipDraw() allows drawing into it on skipped frames too. Frames
+ * are only skipped after one has been drawn, so buffers are learned
+ * before any frame that touches them is skipped.
+ *
+ * The tracking runs the CPU under the watch policy, but only once a
+ * renderer has drawn into RDRAM through frameskipDraw(); until then
+ * skipping only saves VI scan-out and costs nothing. An interval of 0 or
+ * 1, the default, skips nothing.
+ */
+
+struct FrameskipState {
+	unsigned interval;
+	/* Whether the current frame is skipped, and frames since set */
+	bool skipping;
+	uint64_t frame;
+	uint64_t skipped;
+	/* Holding a cpuWatch() reference for the page tracking */
+	bool tracking;
+	/* Pages the CPU read after a drawn frame rendered into them */
+	bool readback[rdramPages];
+};
+
+/* Draw one frame in interval, forgetting what was learned so far. */
+extern void
+frameskipSet(unsigned interval);
+
+/* Start the next frame. Called by the VI at vertical sync. */
+extern void
+frameskipFrame();
+
+/* Whether to rasterize into [addr, addr + size) in the current frame. */
+extern bool
+frameskipDraw(uint32_t addr, uint32_t size);
+
+/* Called under the watch policy for a load from a WatchReadback page. */
+extern void
+frameskipReadback(uint32_t paddr);
@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bits.h"
+#include "bus.h"
+#include "emulator.h"
+#include "idle.h"
+#include "mem.h"
+
+/*
+ * Registers read and written by one instruction of a candidate loop, as
+ * bitmasks over the GPRs. Returns false for anything with side effects.
+ */
+static bool
+classify(uint32_t opcode, uint32_t &reads, uint32_t &writes)
+{
+	uint32_t op = opcode >> 26;
+	uint32_t rs = 1u << ((opcode >> 21) & 31);
+	uint32_t rt = 1u << ((opcode >> 16) & 31);
+	uint32_t rd = 1u << ((opcode >> 11) & 31);
+
+	switch (op) {
+	case 0b000000:
+		switch (opcode & 63) {
+		case 0b000000: /* SLL */
+		case 0b000010: /* SRL */
+		case 0b000011: /* SRA */
+			reads = rt;
+			writes = rd;
+			return true;
+		case 0b000100: /* SLLV */
+		case 0b000110: /* SRLV */
+		case 0b000111: /* SRAV */
+		case 0b100001: /* ADDU */
+		case 0b100011: /* SUBU */
+		case 0b100100: /* AND */
+		case 0b100101: /* OR */
+		case 0b100110: /* XOR */
+		case 0b100111: /* NOR */
+		case 0b101010: /* SLT */
+		case 0b101011: /* SLTU */
+		case 0b101101: /* DADDU */
+		case 0b101111: /* DSUBU */
+			reads = rs | rt;
+			writes = rd;
+			return true;
+		}
+		return false;
+	case 0b001001: /* ADDIU */
+	case 0b001010: /* SLTI */
+	case 0b001011: /* SLTIU */
+	case 0b001100: /* ANDI */
+	case 0b001101: /* ORI */
+	case 0b001110: /* XORI */
+	case 0b011001: /* DADDIU */
+	case 0b100000: /* LB */
+	case 0b100001: /* LH */
+	case 0b100011: /* LW */
+	case 0b100100: /* LBU */
+	case 0b100101: /* LHU */
+	case 0b100111: /* LWU */
+	case 0b110111: /* LD */
+		reads = rs;
+		writes = rt;
+		return true;
+	case 0b001111: /* LUI */
+		reads = 0;
+		writes = rt;
+		return true;
+	}
+	return false;
+}
+
+/*
+ * Registers read by a conditional branch or J whose taken target is
+ * target. Returns false for anything else, including linking branches.
+ */
+static bool
+branchTo(uint64_t pc, uint32_t opcode, uint64_t target, uint32_t &reads)
+{
+	uint32_t op = opcode >> 26;
+	uint32_t rs = 1u << ((opcode >> 21) & 31);
+	uint32_t rt = 1u << ((opcode >> 16) & 31);
+	uint64_t relative = pc + 4 + (int64_t)(int16_t)opcode * 4;
+
+	switch (op) {
+	case 0b000010: /* J */
+		reads = 0;
+		return ((pc + 4) & ~0x0fffffffull) +
+			       ((opcode & 0x03ffffff) << 2) == target;
+	case 0b000001:
+		switch ((opcode >> 16) & 31) {
+		case 0b00000: /* BLTZ */
+		case 0b00001: /* BGEZ */
+		case 0b00010: /* BLTZL */
+		case 0b00011: /* BGEZL */
+			reads = rs;
+			return relative == target;
+		}
+		return false;
+	case 0b000100: /* BEQ */
+	case 0b000101: /* BNE */
+	case 0b010100: /* BEQL */
+	case 0b010101: /* BNEL */
+		reads = rs | rt;
+		return relative == target;
+	case 0b000110: /* BLEZ */
+	case 0b000111: /* BGTZ */
+	case 0b010110: /* BLEZL */
+	case 0b010111: /* BGTZL */
+		reads = rs;
+		return relative == target;
+	}
+	return false;
+}
+
+/* Every instruction classify() accepts from LB up is a load. */
+static inline bool
+isLoad(uint32_t opcode)
+{
+	return bitField<26, 6>(opcode) >= 0b100000;
+}
+
+static bool
+analyze(uint64_t branch, uint64_t target, IdleEntry &e)
+{
+	int count = (int)((branch - target) >> 2) + 2;
+	uint32_t opcodes[idleLoopMax];
+	uint32_t reads[idleLoopMax], writes[idleLoopMax];
+	uint32_t written = 0;
+
+	if (count > idleLoopMax) {
+		return false;
+	}
+	for (int i = 0; i < count; i++) {
+		uint64_t pc = target + 4 * (uint64_t)i;
+		uint32_t opcode = busRead32(pc & 0x1fffffff);
+		bool ok;
+		if (i == count - 2) {
+			writes[i] = 0;
+			ok = branchTo(pc, opcode, target, reads[i]);
+		} else {
+			ok = classify(opcode, reads[i], writes[i]);
+		}
+		if (!ok) {
+			return false;
+		}
+		opcodes[i] = opcode;
+		written |= writes[i];
+	}
+
+	/*
+	 * Find what each load reads: a constant if its base was set by a LUI
+	 * earlier in the loop, otherwise a register from outside it, which
+	 * idleLoop() checks on entry. Bases set any other way are carried
+	 * values or unknown, so the loop is rejected.
+	 */
+	uint32_t constant = 0;
+	uint64_t value[32];
+	e.loads = 0;
+	for (int i = 0; i < count; i++) {
+		uint32_t opcode = opcodes[i];
+		if (i != count - 2 && isLoad(opcode)) {
+			uint8_t base = bitField<21, 5>(opcode);
+			int16_t offset = (int16_t)signExtend<16>(opcode);
+			if (constant & 1u << base) {
+				uint64_t vaddr = value[base] + offset;
+				if (!isRDRAM(vaddr & 0x1fffffff)) {
+					return false;
+				}
+			} else if (written & 1u << base & ~1u) {
+				return false;
+			} else {
+				e.load[e.loads++] = { base, offset };
+			}
+		}
+		constant &= ~writes[i];
+		if (i != count - 2 && bitField<26, 6>(opcode) == 0b001111) {
+			uint8_t rt = bitField<16, 5>(opcode);
+			constant |= 1u << rt;
+			value[rt] = (uint64_t)signExtend<16>(opcode) << 16;
+		}
+	}
+
+	/*
+	 * Any register the loop writes must be written before it is read in
+	 * every iteration. Writes to r0 are discarded, so it never counts.
+	 */
+	written &= ~1u;
+	uint32_t defined = 0;
+	for (int i = 0; i < count; i++) {
+		if (reads[i] & written & ~defined) {
+			return false;
+		}
+		defined |= writes[i];
+	}
+	return true;
+}
+
+/* Whether the loads based on registers from outside the loop hit RDRAM. */
+static bool
+loadsRDRAM(const IdleEntry &e)
+{
+	for (int i = 0; i < e.loads; i++) {
+		uint64_t vaddr = reg->gpr[e.load[i].base] + e.load[i].offset;
+		if (!isRDRAM(vaddr & 0x1fffffff)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Code on this page may have changed; drop every verdict touching it. */
+static void
+forget(uint32_t page)
+{
+	mem->dirty[page] &= ~DirtyIdle;
+	for (IdleEntry &e : emu->idle.entries) {
+		if (e.valid && (e.branch >> rdramPageShift == page ||
+				e.target >> rdramPageShift == page)) {
+			e.valid = false;
+		}
+	}
+}
+
+bool
+idleLoop(uint64_t branch, uint64_t target)
+{
+	if (branch - target > 4 * (idleLoopMax - 2)) {
+		return false;
+	}
+
+	uint32_t paddr = branch & 0x1fffffff;
+	if (paddr >= rdramSize) {
+		IdleEntry e;
+		return analyze(branch, target, e) && loadsRDRAM(e);
+	}
+
+	/* A loop may straddle two pages, so check where it starts and ends. */
+	uint32_t first = (uint32_t)(target & 0x1fffffff) >> rdramPageShift;
+	uint32_t last = (paddr + 4) >> rdramPageShift;
+	for (uint32_t page = first; page <= last && page < rdramPages; page++) {
+		if (mem->dirty[page] & DirtyIdle) {
+			forget(page);
+		}
+	}
+
+	IdleEntry &e = emu->idle.entries[(paddr >> 2) & (idleCacheSize - 1)];
+	if (!e.valid || e.branch != paddr || e.target != (target & 0x1fffffff)) {
+		e.valid = true;
+		e.branch = paddr;
+		e.target = (uint32_t)target & 0x1fffffff;
+		e.idle = analyze(branch, target, e);
+	}
+	return e.idle && loadsRDRAM(e);
+}
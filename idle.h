@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+/*
+ * Idle loop detection. Games often wait for the next interrupt in a short
+ * loop that only polls memory or a device register, e.g.
+ *
+ *	1:	lw	t0, 0x0008(a0)
+ *		beqz	t0, 1b
+ *		nop
+ *
+ * Nothing such a loop does can change what it sees until some scheduled
+ * event fires, so the CPU may skip straight to that event instead of
+ * spinning. A loop qualifies if it is at most idleLoopMax instructions
+ * including the delay slot, performs no stores, jumps, traps or
+ * coprocessor accesses, and has no register value carried from one
+ * iteration to the next (so counters and pointer walks are rejected).
+ *
+ * Loads must read RDRAM. Device registers such as VI_CURRENT change with
+ * time rather than at events, so skipping could jump past the value the
+ * loop waits for. A load based on a LUI in the loop is checked when the
+ * loop is analysed; one based on a register from outside the loop is
+ * checked against that register every time the loop is entered.
+ */
+
+static const int idleLoopMax = 8;
+
+static const int idleCacheSize = 256;
+
+struct IdleLoad {
+	uint8_t base;
+	int16_t offset;
+};
+
+struct IdleEntry {
+	bool valid;
+	bool idle;
+	uint8_t loads;
+	uint32_t branch;
+	uint32_t target;
+	/* Loads whose base register is set outside the loop */
+	IdleLoad load[idleLoopMax];
+};
+
+/* Verdicts by branch address, direct mapped. */
+struct IdleCache {
+	IdleEntry entries[idleCacheSize];
+};
+
+/*
+ * Whether the backward branch at branch (whose delay slot has just run)
+ * into target closes an idle loop. Both are virtual addresses. Verdicts
+ * for loops in RDRAM are cached until their page is written.
+ */
+extern bool
+idleLoop(uint64_t branch, uint64_t target);
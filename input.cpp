@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <SDL.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+
+#include "input.h"
+#include "movie.h"
+
+using Clock = std::chrono::steady_clock;
+
+static const int stickRange = 80;
+static const int cThreshold = 16384;
+static const uint32_t latencyReportInterval = 300;
+
+static SDL_GameController *controllers[4];
+
+static bool latencyMode;
+/* Set on the emulation thread, taken on the presentation thread */
+static std::atomic<bool> pollPending;
+static std::atomic<Clock::rep> pollTime;
+static uint32_t latencySamples;
+static double latencyTotal;
+static double latencyMin;
+static double latencyMax;
+
+bool
+inputInit()
+{
+	if (SDL_InitSubSystem(SDL_INIT_GAMECONTROLLER) != 0) {
+		return false;
+	}
+	int port = 0;
+	for (int i = 0; i < SDL_NumJoysticks() && port < 4; i++) {
+		if (SDL_IsGameController(i)) {
+			controllers[port++] = SDL_GameControllerOpen(i);
+		}
+	}
+	return true;
+}
+
+void
+inputShutdown()
+{
+	for (SDL_GameController *&c : controllers) {
+		if (c) {
+			SDL_GameControllerClose(c);
+			c = nullptr;
+		}
+	}
+	SDL_QuitSubSystem(SDL_INIT_GAMECONTROLLER);
+}
+
+static int8_t
+stick(SDL_GameController *c, SDL_GameControllerAxis axis, bool invert)
+{
+	int v = SDL_GameControllerGetAxis(c, axis) * stickRange / 32767;
+	return (int8_t)(invert ? -v : v);
+}
+
+/*
+ * Read the pad directly rather than from state cached by the last event
+ * pump, so what the game sees is as fresh as possible.
+ */
+static ControllerState
+liveController(int port)
+{
+	static const struct {
+		SDL_GameControllerButton from;
+		uint16_t to;
+	} buttons[] = {
+		{ SDL_CONTROLLER_BUTTON_A, ButtonA },
+		{ SDL_CONTROLLER_BUTTON_X, ButtonB },
+		{ SDL_CONTROLLER_BUTTON_START, ButtonStart },
+		{ SDL_CONTROLLER_BUTTON_LEFTSHOULDER, ButtonL },
+		{ SDL_CONTROLLER_BUTTON_RIGHTSHOULDER, ButtonR },
+		{ SDL_CONTROLLER_BUTTON_DPAD_UP, ButtonDUp },
+		{ SDL_CONTROLLER_BUTTON_DPAD_DOWN, ButtonDDown },
+		{ SDL_CONTROLLER_BUTTON_DPAD_LEFT, ButtonDLeft },
+		{ SDL_CONTROLLER_BUTTON_DPAD_RIGHT, ButtonDRight },
+	};
+	ControllerState state = {};
+	SDL_GameController *c = controllers[port];
+
+	if (!c) {
+		return state;
+	}
+	SDL_GameControllerUpdate();
+
+	for (const auto &b : buttons) {
+		if (SDL_GameControllerGetButton(c, b.from)) {
+			state.buttons |= b.to;
+		}
+	}
+	if (SDL_GameControllerGetAxis(c, SDL_CONTROLLER_AXIS_TRIGGERLEFT) >
+	    cThreshold) {
+		state.buttons |= ButtonZ;
+	}
+
+	int cx = SDL_GameControllerGetAxis(c, SDL_CONTROLLER_AXIS_RIGHTX);
+	int cy = SDL_GameControllerGetAxis(c, SDL_CONTROLLER_AXIS_RIGHTY);
+	if (cx > cThreshold) {
+		state.buttons |= ButtonCRight;
+	} else if (cx < -cThreshold) {
+		state.buttons |= ButtonCLeft;
+	}
+	if (cy > cThreshold) {
+		state.buttons |= ButtonCDown;
+	} else if (cy < -cThreshold) {
+		state.buttons |= ButtonCUp;
+	}
+
+	state.stickX = stick(c, SDL_CONTROLLER_AXIS_LEFTX, false);
+	state.stickY = stick(c, SDL_CONTROLLER_AXIS_LEFTY, true);
+	return state;
+}
+
+ControllerState
+pollController(int port)
+{
+	ControllerState state = {};
+
+	/* Games poll once per frame, which is what latency is measured from */
+	if (port == 0 && latencyMode && !pollPending) {
+		pollTime = Clock::now().time_since_epoch().count();
+		pollPending = true;
+	}
+
+	if (movieMode() == MoviePlaying) {
+		movieInput(port, state);
+		return state;
+	}
+
+	state = liveController(port);
+
+	if (movieMode() == MovieRecording) {
+		movieInput(port, state);
+	}
+	return state;
+}
+
+void
+inputSetLatencyMode(bool enabled)
+{
+	latencyMode = enabled;
+	pollPending = false;
+	latencySamples = 0;
+}
+
+void
+inputFramePresented()
+{
+	if (!latencyMode || !pollPending) {
+		return;
+	}
+	pollPending = false;
+
+	Clock::duration since(Clock::now().time_since_epoch().count() -
+			      pollTime);
+	double ms = std::chrono::duration<double, std::milli>(since).count();
+	if (latencySamples == 0) {
+		latencyTotal = 0;
+		latencyMin = ms;
+		latencyMax = ms;
+	}
+	latencySamples++;
+	latencyTotal += ms;
+	latencyMin = ms < latencyMin ? ms : latencyMin;
+	latencyMax = ms > latencyMax ? ms : latencyMax;
+
+	if (latencySamples == latencyReportInterval) {
+		fprintf(stderr,
+			"input: poll to present %.2f ms avg, %.2f min, "
+			"%.2f max over %u frames\n",
+			latencyTotal / latencySamples, latencyMin, latencyMax,
+			latencySamples);
+		latencySamples = 0;
+	}
+}
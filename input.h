@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+/* One controller as seen by a status/read poll from the game. */
+struct ControllerState {
+	uint16_t buttons;
+	int8_t stickX;
+	int8_t stickY;
+};
+
+/*
+ * Sample a controller port. This is the single point where outside input
+ * enters the emulator: the game's controller poll lands here, and the
+ * movie recorder/player hooks in at this granularity.
+ */
+extern ControllerState
+pollController(int port);
+
+/* N64 button bits as returned by the joybus read command. */
+enum ControllerButton : uint16_t {
+	ButtonCRight = 1 << 0,
+	ButtonCLeft = 1 << 1,
+	ButtonCDown = 1 << 2,
+	ButtonCUp = 1 << 3,
+	ButtonR = 1 << 4,
+	ButtonL = 1 << 5,
+	ButtonDRight = 1 << 8,
+	ButtonDLeft = 1 << 9,
+	ButtonDDown = 1 << 10,
+	ButtonDUp = 1 << 11,
+	ButtonStart = 1 << 12,
+	ButtonZ = 1 << 13,
+	ButtonB = 1 << 14,
+	ButtonA = 1 << 15,
+};
+
+/*
+ * Open SDL game controllers for live input. Without this (e.g. headless
+ * replays) every port reads as an idle controller.
+ */
+extern bool
+inputInit();
+
+extern void
+inputShutdown();
+
+/*
+ * Latency measurement: when enabled, the time from the game's port 0
+ * poll to the presentation of the next frame is sampled and reported to
+ * stderr every few seconds. The frontend calls inputFramePresented()
+ * right after each present.
+ */
+extern void
+inputSetLatencyMode(bool enabled);
+
+extern void
+inputFramePresented();
@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "disasm.h"
+#include "emulator.h"
+#include "gui/imgui.h"
+#include "inspector.h"
+
+void
+inspectorPublish(Emulator *e)
+{
+	InspectState &s = e->inspect;
+
+	if (!s.wanted) {
+		return;
+	}
+	int target = s.published == 0 ? 1 : 0;
+	if (s.reading == target) {
+		/* Still on screen from two frames ago */
+		return;
+	}
+	s.wanted = false;
+
+	Emulator *previous = emulatorBind(e);
+	InspectSnapshot &snap = s.snapshots[target];
+
+	snap.cycles = sched->cycles;
+	snap.cpu = *reg;
+	snap.cpu.cop0[COP0Count] = cpuReadCount();
+	snap.rsp = *rcp;
+
+	snap.memoryAddress = s.memoryAddress & (rdramSize - 4);
+	for (uint32_t i = 0; i < inspectMemoryWords; i++) {
+		snap.memory[i] = rdramRead32(snap.memoryAddress + 4 * i);
+	}
+
+	/* KSEG0/KSEG1 only until there is a TLB */
+	uint32_t pc = (uint32_t)reg->pc & ~3u;
+	snap.codeValid = (pc & 0x1fffffff) < mem->size;
+	snap.codeAddress = pc - inspectCodeWords / 2 * 4;
+	if (snap.codeValid) {
+		for (uint32_t i = 0; i < inspectCodeWords; i++) {
+			uint32_t vaddr = snap.codeAddress + 4 * i;
+			snap.code[i] = rdramRead32(vaddr & 0x1fffffff);
+		}
+	}
+	memcpy(snap.imem, sp->imem, sizeof(snap.imem));
+
+	emulatorBind(previous);
+	s.published = target;
+}
+
+/*
+ * Pin the latest snapshot for drawing, and ask for a fresh one. Returns
+ * null until the first publish.
+ */
+static const InspectSnapshot *
+acquire(Emulator *e)
+{
+	InspectState &s = e->inspect;
+	int i;
+
+	s.wanted = true;
+	do {
+		i = s.published;
+		if (i < 0) {
+			return nullptr;
+		}
+		s.reading = i;
+		/* A publish in between may have been writing into i */
+	} while (s.published != i);
+	return &s.snapshots[i];
+}
+
+static void
+release(Emulator *e)
+{
+	e->inspect.reading = -1;
+}
+
+static void
+gprTable(const char *id, const Registers &r, bool wide)
+{
+	ImGui::Columns(4, id, false);
+	for (int i = 0; i < 32; i++) {
+		if (wide) {
+			ImGui::Text("%-4s %016llx", gprName(i),
+				    (unsigned long long)r.gpr[i]);
+		} else {
+			ImGui::Text("%-4s %08x", gprName(i), (uint32_t)r.gpr[i]);
+		}
+		ImGui::NextColumn();
+	}
+	ImGui::Columns(1);
+}
+
+void
+registersWindow(Emulator *e, bool *open)
+{
+	static const int cop0Shown[] = {
+		COP0Status, COP0Cause, COP0EPC, COP0ErrorEPC,
+		COP0BadVAddr, COP0Count, COP0Compare, COP0Config,
+	};
+
+	if (!ImGui::Begin("Registers", open)) {
+		ImGui::End();
+		return;
+	}
+	const InspectSnapshot *snap = acquire(e);
+	if (!snap) {
+		ImGui::TextUnformatted("Waiting for a frame");
+		ImGui::End();
+		return;
+	}
+
+	ImGui::Text("Cycle %llu", (unsigned long long)snap->cycles);
+	if (ImGui::CollapsingHeader("VR4300", ImGuiTreeNodeFlags_DefaultOpen)) {
+		const Registers &r = snap->cpu;
+		ImGui::Text("pc   %016llx%s", (unsigned long long)r.pc,
+			    r.delaySlot ? " (delay slot)" : "");
+		ImGui::Text("hi   %016llx  lo   %016llx",
+			    (unsigned long long)r.hi, (unsigned long long)r.lo);
+		gprTable("cpu gpr", r, true);
+		if (ImGui::TreeNode("COP0")) {
+			for (int i : cop0Shown) {
+				ImGui::Text("%-9s %016llx", cop0Name(i),
+					    (unsigned long long)r.cop0[i]);
+			}
+			ImGui::TreePop();
+		}
+		if (ImGui::TreeNode("FPU")) {
+			ImGui::Text("fcr31 %08x", r.fcr31);
+			ImGui::Columns(4, "fpr", false);
+			for (int i = 0; i < 32; i++) {
+				ImGui::Text("f%-2d %016llx", i,
+					    (unsigned long long)r.fpr[i]);
+				ImGui::NextColumn();
+			}
+			ImGui::Columns(1);
+			ImGui::TreePop();
+		}
+	}
+	if (ImGui::CollapsingHeader("RSP", ImGuiTreeNodeFlags_DefaultOpen)) {
+		const Registers &r = snap->rsp;
+		ImGui::Text("pc   %03x", (uint32_t)r.pc & 0xffc);
+		gprTable("rsp gpr", r, false);
+	}
+
+	release(e);
+	ImGui::End();
+}
+
+void
+memoryWindow(Emulator *e, bool *open)
+{
+	static char address[9] = "0";
+
+	if (!ImGui::Begin("Memory", open)) {
+		ImGui::End();
+		return;
+	}
+	if (ImGui::InputText("Address", address, sizeof(address),
+			     ImGuiInputTextFlags_CharsHexadecimal |
+				     ImGuiInputTextFlags_EnterReturnsTrue)) {
+		/* KSEG0/KSEG1 addresses work too */
+		e->inspect.memoryAddress =
+			(uint32_t)strtoul(address, nullptr, 16) & 0x1ffffff0;
+	}
+	const InspectSnapshot *snap = acquire(e);
+	if (!snap) {
+		ImGui::TextUnformatted("Waiting for a frame");
+		ImGui::End();
+		return;
+	}
+
+	ImGui::BeginChild("hex");
+	ImGuiListClipper clipper;
+	clipper.Begin(inspectMemoryWords / 4);
+	while (clipper.Step()) {
+		for (int row = clipper.DisplayStart; row < clipper.DisplayEnd;
+		     row++) {
+			char hex[16 * 3 + 1];
+			char ascii[16 + 1];
+			for (int i = 0; i < 16; i++) {
+				uint32_t word = snap->memory[row * 4 + i / 4];
+				uint8_t b = (uint8_t)(word >> (24 - 8 * (i & 3)));
+				snprintf(hex + 3 * i, 4, "%02x ", b);
+				ascii[i] = b >= 0x20 && b < 0x7f ? (char)b : '.';
+			}
+			ascii[16] = 0;
+			ImGui::Text("%08x  %s %s",
+				    snap->memoryAddress + 16 * row, hex, ascii);
+		}
+	}
+	ImGui::EndChild();
+
+	release(e);
+	ImGui::End();
+}
+
+void
+disassemblyWindow(Emulator *e, bool *open)
+{
+	if (!ImGui::Begin("Disassembly", open)) {
+		ImGui::End();
+		return;
+	}
+	const InspectSnapshot *snap = acquire(e);
+	if (!snap) {
+		ImGui::TextUnformatted("Waiting for a frame");
+		ImGui::End();
+		return;
+	}
+
+	char text[disasmMaxLength];
+	if (ImGui::CollapsingHeader("VR4300", ImGuiTreeNodeFlags_DefaultOpen)) {
+		uint32_t pc = (uint32_t)snap->cpu.pc;
+		if (!snap->codeValid) {
+			ImGui::Text("pc %08x is not in RDRAM", pc);
+		}
+		for (uint32_t i = 0; snap->codeValid && i < inspectCodeWords;
+		     i++) {
+			uint32_t vaddr = snap->codeAddress + 4 * i;
+			disassembleVR4300(snap->code[i], (int32_t)vaddr, text,
+					  sizeof(text));
+			ImGui::Text("%c %08x  %08x  %s", vaddr == pc ? '>' : ' ',
+				    vaddr, snap->code[i], text);
+		}
+	}
+	if (ImGui::CollapsingHeader("RSP", ImGuiTreeNodeFlags_DefaultOpen)) {
+		uint32_t pc = (uint32_t)snap->rsp.pc & 0xffc;
+		uint32_t start = pc < 64 ? 0 : pc - 64;
+		uint32_t end = start + 128 > 4096 ? 4096 : start + 128;
+		for (uint32_t a = start; a < end; a += 4) {
+			const uint8_t *p = &snap->imem[a];
+			uint32_t op = (uint32_t)p[0] << 24 | p[1] << 16 |
+				      p[2] << 8 | p[3];
+			disassembleRSP(op, a, text, sizeof(text));
+			ImGui::Text("%c %03x  %08x  %s", a == pc ? '>' : ' ', a,
+				    op, text);
+		}
+	}
+
+	release(e);
+	ImGui::End();
+}
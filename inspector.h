@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "cpu.h"
+
+struct Emulator;
+
+/*
+ * Register, memory and disassembly views of a running instance.
+ *
+ * The windows never touch live state. Once per frame the emulation
+ * thread calls inspectorPublish(), which copies the registers and the
+ * memory the windows are looking at into the back one of two snapshots
+ * and then publishes it. The windows draw from the published snapshot,
+ * pinning it while they do so that it is not overwritten under them; if
+ * the back buffer is pinned the publish waits for the next frame.
+ *
+ * Publishing costs a few KiB of copying, and only on frames after a
+ * window asked for data, so an instance nobody inspects does no work at
+ * all. Nothing in the emulated machine is read through the bus, so the
+ * views cannot have side effects on it.
+ */
+
+/* The RDRAM hex view covers this many words from its address. */
+static const uint32_t inspectMemoryWords = 1024;
+/* The CPU disassembly covers this many words around pc. */
+static const uint32_t inspectCodeWords = 64;
+
+struct InspectSnapshot {
+	uint64_t cycles;
+	Registers cpu;
+	Registers rsp;
+	uint32_t memoryAddress;
+	uint32_t memory[inspectMemoryWords];
+	/* Only when the CPU is executing from RDRAM */
+	bool codeValid;
+	uint32_t codeAddress;
+	uint32_t code[inspectCodeWords];
+	uint8_t imem[4096];
+};
+
+struct InspectState {
+	InspectSnapshot snapshots[2];
+	/* The latest snapshot, and the one a window is drawing; or -1 */
+	std::atomic<int> published{ -1 };
+	std::atomic<int> reading{ -1 };
+	/* Set by the windows, cleared by the next publish */
+	std::atomic<bool> wanted{ false };
+	/* Start of the RDRAM hex view */
+	std::atomic<uint32_t> memoryAddress{ 0 };
+};
+
+/* Take a snapshot of e if a window wants one. Emulation thread only. */
+extern void
+inspectorPublish(Emulator *e);
+
+/* CPU and RSP registers. */
+extern void
+registersWindow(Emulator *e, bool *open);
+
+/* Hex view of RDRAM. */
+extern void
+memoryWindow(Emulator *e, bool *open);
+
+/* Disassembly around the CPU and RSP program counters. */
+extern void
+disassemblyWindow(Emulator *e, bool *open);
@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstring>
+
+#include "lz.h"
+
+static const size_t minMatch = 4;
+static const size_t maxOffset = 65535;
+static const int hashBits = 14;
+
+static inline uint32_t
+load32(const uint8_t *p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint64_t
+load64(const uint8_t *p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t
+hash(uint32_t v)
+{
+	return (v * 2654435761u) >> (32 - hashBits);
+}
+
+/* Length of the common prefix of a and b, stopping at limit. */
+static inline size_t
+commonLength(const uint8_t *a, const uint8_t *b, const uint8_t *limit)
+{
+	const uint8_t *start = b;
+
+	while (b + 8 <= limit) {
+		uint64_t diff = load64(a) ^ load64(b);
+		if (diff) {
+			return (b - start) + (__builtin_ctzll(diff) >> 3);
+		}
+		a += 8;
+		b += 8;
+	}
+	while (b < limit && *a == *b) {
+		a++;
+		b++;
+	}
+	return b - start;
+}
+
+static inline uint8_t *
+putLength(uint8_t *op, size_t len)
+{
+	while (len >= 255) {
+		*op++ = 255;
+		len -= 255;
+	}
+	*op++ = (uint8_t)len;
+	return op;
+}
+
+/* Emit one sequence. A match length of zero marks the final sequence. */
+static uint8_t *
+putSequence(uint8_t *op, uint8_t *oend, const uint8_t *lit, size_t litLen,
+	    size_t offset, size_t matchLen)
+{
+	size_t need = 1 + litLen + litLen / 255 + 1;
+	if (matchLen) {
+		need += 2 + matchLen / 255 + 1;
+	}
+	if ((size_t)(oend - op) < need) {
+		return nullptr;
+	}
+
+	size_t m = matchLen ? matchLen - minMatch : 0;
+	uint8_t *token = op++;
+	*token = (uint8_t)((litLen < 15 ? litLen : 15) << 4 | (m < 15 ? m : 15));
+	if (litLen >= 15) {
+		op = putLength(op, litLen - 15);
+	}
+	memcpy(op, lit, litLen);
+	op += litLen;
+
+	if (matchLen) {
+		*op++ = (uint8_t)offset;
+		*op++ = (uint8_t)(offset >> 8);
+		if (m >= 15) {
+			op = putLength(op, m - 15);
+		}
+	}
+	return op;
+}
+
+size_t
+lzBound(size_t size)
+{
+	return size + size / 255 + 16;
+}
+
+size_t
+lzCompress(const uint8_t *src, size_t size, uint8_t *dst, size_t capacity)
+{
+	uint32_t table[1 << hashBits];
+	const uint8_t *ip = src;
+	const uint8_t *anchor = src;
+	const uint8_t *iend = src + size;
+	uint8_t *op = dst;
+	uint8_t *oend = dst + capacity;
+
+	memset(table, 0, sizeof(table));
+
+	while (ip + 8 <= iend) {
+		uint32_t seq = load32(ip);
+		uint32_t h = hash(seq);
+		const uint8_t *ref = src + table[h];
+		table[h] = (uint32_t)(ip - src);
+
+		if (ref >= ip || (size_t)(ip - ref) > maxOffset ||
+		    load32(ref) != seq) {
+			/* Skip ahead faster through incompressible data. */
+			ip += 1 + ((ip - anchor) >> 6);
+			continue;
+		}
+
+		size_t len = minMatch +
+			     commonLength(ref + minMatch, ip + minMatch, iend);
+		op = putSequence(op, oend, anchor, ip - anchor, ip - ref, len);
+		if (!op) {
+			return 0;
+		}
+		ip += len;
+		anchor = ip;
+		if (ip - 2 >= src && ip + 8 <= iend) {
+			table[hash(load32(ip - 2))] = (uint32_t)(ip - 2 - src);
+		}
+	}
+
+	op = putSequence(op, oend, anchor, iend - anchor, 0, 0);
+	if (!op) {
+		return 0;
+	}
+	return op - dst;
+}
+
+static inline bool
+getLength(const uint8_t *&ip, const uint8_t *iend, size_t &len)
+{
+	uint8_t b;
+	do {
+		if (ip >= iend) {
+			return false;
+		}
+		b = *ip++;
+		len += b;
+	} while (b == 255);
+	return true;
+}
+
+bool
+lzDecompress(const uint8_t *src, size_t size, uint8_t *dst, size_t dstSize)
+{
+	const uint8_t *ip = src;
+	const uint8_t *iend = src + size;
+	uint8_t *op = dst;
+	uint8_t *oend = dst + dstSize;
+
+	while (ip < iend) {
+		uint8_t token = *ip++;
+
+		size_t litLen = token >> 4;
+		if (litLen == 15 && !getLength(ip, iend, litLen)) {
+			return false;
+		}
+		if ((size_t)(iend - ip) < litLen ||
+		    (size_t)(oend - op) < litLen) {
+			return false;
+		}
+		memcpy(op, ip, litLen);
+		ip += litLen;
+		op += litLen;
+
+		if (ip == iend) {
+			break;
+		}
+
+		if (iend - ip < 2) {
+			return false;
+		}
+		size_t offset = ip[0] | (size_t)ip[1] << 8;
+		ip += 2;
+		if (offset == 0 || offset > (size_t)(op - dst)) {
+			return false;
+		}
+
+		size_t matchLen = token & 15;
+		if (matchLen == 15 && !getLength(ip, iend, matchLen)) {
+			return false;
+		}
+		matchLen += minMatch;
+		if ((size_t)(oend - op) < matchLen) {
+			return false;
+		}
+
+		const uint8_t *ref = op - offset;
+		if (offset == 1) {
+			memset(op, *ref, matchLen);
+		} else if (offset >= matchLen) {
+			memcpy(op, ref, matchLen);
+		} else {
+			for (size_t i = 0; i < matchLen; i++) {
+				op[i] = ref[i];
+			}
+		}
+		op += matchLen;
+	}
+
+	return op == oend;
+}
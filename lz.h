@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * A small LZ77 block codec in the spirit of LZ4, used for save states.
+ *
+ * A block is a run of sequences. Each sequence starts with a token byte
+ * whose high nibble is the literal count and low nibble is the match
+ * length minus four; a nibble of 15 means more length bytes follow, each
+ * adding up to 255. Then come the literals, a 16-bit little-endian match
+ * offset and any extra match length bytes. The final sequence has
+ * literals only. RDRAM is mostly long zero runs, which become a single
+ * offset-1 match and decode as a memset.
+ */
+
+/* Worst case compressed size for an input of the given size. */
+extern size_t
+lzBound(size_t size);
+
+/*
+ * Compress src into dst. Returns the compressed size, or 0 if dst is too
+ * small to hold the result.
+ */
+extern size_t
+lzCompress(const uint8_t *src, size_t size, uint8_t *dst, size_t capacity);
+
+/*
+ * Decompress src into dst, which must be exactly the original size.
+ * Returns false if the block is corrupt or does not fill dst exactly.
+ */
+extern bool
+lzDecompress(const uint8_t *src, size_t size, uint8_t *dst, size_t dstSize);
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/*
+ * Hands finished frames from the emulation thread to the presentation
+ * thread without either one ever waiting. Of three frames, the producer
+ * draws into one and the consumer shows another; the third is swapped
+ * with whichever side is done. The newest frame always wins, so frames
+ * the consumer was too slow for are dropped rather than queued.
+ */
+
+static const uint32_t frameMaxWidth = 640;
+static const uint32_t frameMaxHeight = 480;
+
+/* RGBA8, rows of width pixels packed together. Empty when blanked. */
+struct Frame {
+	uint32_t width;
+	uint32_t height;
+	uint32_t pixels[frameMaxWidth * frameMaxHeight];
+};
+
+/* Set in shared while it holds a frame the consumer has not taken. */
+static const int mailboxFresh = 4;
+
+struct FrameMailbox {
+	Frame frames[3];
+	/* Owned by the producer and the consumer respectively */
+	int back = 0;
+	int front = 1;
+	std::atomic<int> shared{ 2 };
+};
+
+/* The frame for the producer to draw into. */
+static inline Frame *
+mailboxBack(FrameMailbox &m)
+{
+	return &m.frames[m.back];
+}
+
+/* Hand the back frame over, replacing any frame not yet taken. */
+static inline void
+mailboxPublish(FrameMailbox &m)
+{
+	m.back = m.shared.exchange(m.back | mailboxFresh) & 3;
+}
+
+/* Whether the consumer has taken the last published frame. */
+static inline bool
+mailboxTaken(const FrameMailbox &m)
+{
+	return !(m.shared.load() & mailboxFresh);
+}
+
+/* The newest frame if it has not been taken yet, else null. */
+static inline const Frame *
+mailboxTake(FrameMailbox &m)
+{
+	if (mailboxTaken(m)) {
+		return nullptr;
+	}
+	m.front = m.shared.exchange(m.front) & 3;
+	return &m.frames[m.front];
+}
@@ -25,18 +25,35 @@
  */
 
 #include <SDL.h>
+#include <chrono>
 #include <climits>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <string>
 
+#include "bus.h"
 #include "cpu.h"
+#include "emulator.h"
+#include "frameskip.h"
+#include "input.h"
+#include "inspector.h"
 #include "mem.h"
+#include "movie.h"
+#include "pif.h"
+#include "present.h"
+#include "profiler.h"
 #include "rcp.h"
+#include "scheduler.h"
+#include "statehash.h"
+#include "timeline.h"
+#include "timers.h"
+#include "trace.h"
+#include "vi.h"
 
-extern Registers reg;
-extern Registers rcp;
+static Emulator *instance;
 
 /*
  * Personal Notes:
@@ -46,26 +63,279 @@ extern Registers rcp;
  * -COP3 is unused and can (probably) be ignored
  */
 
+/* Polls between state hash checkpoints in recorded movies */
+static const uint32_t movieCheckpointInterval = 60;
+
+/* Rewind history kept by the windowed frontend */
+static const size_t rewindBytes = 64 << 20;
+
+/* Frames a replay may run without polling before it is given up on */
+static const uint64_t replayStallFrames = 600;
+
+void
+tick();
+
+[[noreturn]] static void
+usage(const char *program)
+{
+	std::cerr
+		<< "usage: " << program << " [options]\n"
+		<< "  --expansion-pak        fit the 8 MB Expansion Pak\n"
+		<< "  --eeprom4k <file>      fit a 4 Kbit EEPROM kept in file\n"
+		<< "  --eeprom16k <file>     fit a 16 Kbit EEPROM kept in file\n"
+		<< "  --pak <file>           insert a Controller Pak kept in "
+		   "file, up to four\n"
+		<< "  --strict-overflow      trap on signed overflow\n"
+		<< "  --32bit                trap 64-bit operations\n"
+		<< "  --fast-forward         start fast-forwarding\n"
+		<< "  --frameskip <n>        draw one frame in n\n"
+		<< "  --input-latency        report input to present latency\n"
+		<< "  --record <movie>       record input to movie\n"
+		<< "  --replay <movie>       replay movie headless\n"
+		<< "  --benchmark            report replay speed\n"
+		<< "  --hash-log <file>      log a state hash every frame\n"
+		<< "  --trace <file>         record an execution trace\n"
+		<< "  --trace-dump <file>    print an execution trace\n"
+		<< "  --timeline <file>      write a Chrome trace timeline\n"
+		<< "  --profile <file>       write a guest profile\n";
+	exit(2);
+}
+
+/* The value of the option at argv[i], which must have one. */
+static const char *
+optionValue(int argc, char *argv[], int &i)
+{
+	if (i + 1 == argc) {
+		std::cerr << argv[i] << " needs a value" << std::endl;
+		usage(argv[0]);
+	}
+	return argv[++i];
+}
+
+/*
+ * Run a movie headless and as fast as possible. Exits non-zero if the
+ * replay diverged from the recording or stopped polling the controller
+ * before its input ran out, for use in regression tests. A benchmark run
+ * also reports the speed and, if built with timers, where the time went.
+ */
+static int
+replay(const char *path, bool benchmark)
+{
+	emulatorBind(instance);
+	if (!moviePlay(path)) {
+		emulatorBind(nullptr);
+		std::cerr << "Could not load movie " << path << std::endl;
+		return 1;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	uint64_t frames = 0;
+	uint64_t polls = 0, lastPollFrame = 0;
+	bool stalled = false;
+	while (movieMode() == MoviePlaying) {
+		tick();
+		frames++;
+		if (moviePolls() != polls) {
+			polls = moviePolls();
+			lastPollFrame = frames;
+		} else if (frames - lastPollFrame >= replayStallFrames) {
+			stalled = true;
+			movieStop();
+		}
+	}
+	bool diverged = movieDivergence() >= 0;
+	emulatorBind(nullptr);
+	if (stalled) {
+		std::cerr << "movie: no poll for " << replayStallFrames
+			  << " frames after poll " << polls << std::endl;
+	}
+	std::chrono::duration<double> elapsed =
+		std::chrono::steady_clock::now() - start;
+
+	if (benchmark) {
+		printf("%llu frames in %.3f s (%.2fx)\n",
+		       (unsigned long long)frames, elapsed.count(),
+		       frames / 60.0 / elapsed.count());
+		timersReport(stdout);
+	}
+	return diverged || stalled ? 1 : 0;
+}
+
 int
 main(int argc, char *argv[])
 {
-	(void)argc;
-	(void)argv;
+	const char *movie = nullptr;
+	const char *record = nullptr;
+	const char *hashLog = nullptr;
+	const char *trace = nullptr;
+	const char *profile = nullptr;
+	const char *timeline = nullptr;
+	const char *eeprom = nullptr;
+	EEPROMType eepromType = EEPROMNone;
+	/* Controller Pak images, for ports 1-4 in order */
+	const char *paks[4] = {};
+	int pakCount = 0;
+	bool expansionPak = false;
+	bool benchmark = false;
+	bool fastForward = false;
+	unsigned frameskip = 0;
+	CPUOptions cpuOptions;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--strict-overflow")) {
+			cpuOptions.strictOverflow = true;
+		} else if (!strcmp(argv[i], "--32bit")) {
+			cpuOptions.mode64 = false;
+		} else if (!strcmp(argv[i], "--expansion-pak")) {
+			expansionPak = true;
+		} else if (!strcmp(argv[i], "--benchmark")) {
+			benchmark = true;
+		} else if (!strcmp(argv[i], "--fast-forward")) {
+			fastForward = true;
+		} else if (!strcmp(argv[i], "--input-latency")) {
+			inputSetLatencyMode(true);
+		} else if (!strcmp(argv[i], "--replay")) {
+			movie = optionValue(argc, argv, i);
+		} else if (!strcmp(argv[i], "--record")) {
+			record = optionValue(argc, argv, i);
+		} else if (!strcmp(argv[i], "--hash-log")) {
+			hashLog = optionValue(argc, argv, i);
+		} else if (!strcmp(argv[i], "--trace")) {
+			trace = optionValue(argc, argv, i);
+			cpuOptions.trace = true;
+		} else if (!strcmp(argv[i], "--timeline")) {
+			timeline = optionValue(argc, argv, i);
+		} else if (!strcmp(argv[i], "--frameskip")) {
+			const char *n = optionValue(argc, argv, i);
+			char *end;
+			frameskip = (unsigned)strtoul(n, &end, 10);
+			if (!*n || *end) {
+				std::cerr << "--frameskip takes a number"
+					  << std::endl;
+				usage(argv[0]);
+			}
+		} else if (!strcmp(argv[i], "--eeprom4k")) {
+			eepromType = EEPROM4K;
+			eeprom = optionValue(argc, argv, i);
+		} else if (!strcmp(argv[i], "--eeprom16k")) {
+			eepromType = EEPROM16K;
+			eeprom = optionValue(argc, argv, i);
+		} else if (!strcmp(argv[i], "--pak")) {
+			if (pakCount == 4) {
+				std::cerr << "At most four --pak" << std::endl;
+				usage(argv[0]);
+			}
+			paks[pakCount++] = optionValue(argc, argv, i);
+		} else if (!strcmp(argv[i], "--profile")) {
+			profile = optionValue(argc, argv, i);
+		} else if (!strcmp(argv[i], "--trace-dump")) {
+			return traceDump(optionValue(argc, argv, i)) ? 0 : 1;
+		} else {
+			std::cerr << "Unknown option " << argv[i] << std::endl;
+			usage(argv[0]);
+		}
+	}
+
+	if (movie && record) {
+		std::cerr << "--record and --replay cannot be combined"
+			  << std::endl;
+		usage(argv[0]);
+	}
+
+	if (timeline) {
+		timelineStart();
+		timelineThreadName("emulator");
+	}
+
+	/* The frontend drives a single instance from the main thread. */
+	instance = emulatorCreate(cpuOptions);
+	if (!instance) {
+		std::cerr << "Could not allocate emulator memory" << std::endl;
+		return 1;
+	}
+	emulatorBind(instance);
+	rdramSetExpansionPak(expansionPak);
+	frameskipSet(frameskip);
+
+	if (eeprom && !pifLoadEEPROM(eepromType, eeprom)) {
+		std::cerr << "Could not load " << eeprom << std::endl;
+		return 1;
+	}
+	for (int i = 0; i < pakCount; i++) {
+		if (!pifLoadPak(i, paks[i])) {
+			std::cerr << "Could not load " << paks[i] << std::endl;
+			return 1;
+		}
+	}
+
+	if (hashLog && !stateHashLogOpen(hashLog)) {
+		std::cerr << "Could not open " << hashLog << std::endl;
+		return 1;
+	}
+	if (trace && !traceOpen(trace)) {
+		std::cerr << "Could not open " << trace << std::endl;
+		return 1;
+	}
+	/* Starts from a snapshot of the state set up above */
+	if (record && !movieRecord(record, movieCheckpointInterval)) {
+		std::cerr << "Could not record to " << record << std::endl;
+		return 1;
+	}
+
+	if (profile) {
+		profilerStart(instance);
+	}
+
+	/*
+	 * Setup is done; from here on the instance is only bound while it is
+	 * used, so the frontend's own float code runs in the host's modes.
+	 */
+	emulatorBind(nullptr);
+
+	int status;
+	if (movie) {
+		status = replay(movie, benchmark);
+	} else {
+		emulatorSetRewind(instance, rewindBytes);
+		status = presentRun(instance, fastForward);
+	}
+
+	if (profile) {
+		profilerStop();
+		if (!profilerExport(profile)) {
+			std::cerr << "Could not write " << profile << std::endl;
+		}
+	}
+	/* A replay starts from its own state; only keep what a player saved */
+	if (!movie) {
+		emulatorBind(instance);
+		if (eeprom && !pifSaveEEPROM(eeprom)) {
+			std::cerr << "Could not write " << eeprom << std::endl;
+			status = 1;
+		}
+		for (int i = 0; i < pakCount; i++) {
+			if (!pifSavePak(i, paks[i])) {
+				std::cerr << "Could not write " << paks[i]
+					  << std::endl;
+				status = 1;
+			}
+		}
+		emulatorBind(nullptr);
+	}
 
-	return 0;
+	/* Closes the trace and anything else the instance has open */
+	emulatorDestroy(instance);
+	if (timeline && !timelineWrite(timeline)) {
+		std::cerr << "Could not write " << timeline << std::endl;
+	}
+	return status;
 }
 
 void
 tick()
 {
-	for (long long i = 0; i < 31248125; i++) {
-		for (int j = 0; j < 3; j++) {
-			execCPU(mem.mem[reg.pc], 0, false);
-			reg.pc++;
-		}
-		for (int k = 0; k < 2; k++) {
-			execRCP(mem.mem[rcp.pc], false);
-			rcp.pc++;
-		}
-	}
+	/* One frame, as the windowed frontend runs it */
+	emulatorRun(instance, viFrameCycles);
+	inspectorPublish(instance);
+	timersFrame();
 }
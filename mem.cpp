@@ -23,3 +23,101 @@
  * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
  * POSSIBILITY OF SUCH DAMAGE.
  */
+
+#include <cstring>
+
+#include "arena.h"
+#include "byteswap.h"
+#include "mem.h"
+
+void
+rdramSetExpansionPak(bool present)
+{
+	uint32_t size = present ? rdramSize : rdramBaseSize;
+
+	if (size == mem->size) {
+		mem->expansionPak = present;
+		return;
+	}
+	if (!present && mem->size) {
+		arenaRelease(mem->mem + rdramBaseSize, rdramSize - rdramBaseSize);
+		arenaRelease(mem->guestOrder + rdramBaseSize,
+			     rdramSize - rdramBaseSize);
+	}
+	/* Anything cached about the upper half is stale either way. */
+	memset(&mem->dirty[rdramBaseSize >> rdramPageShift], 0xff,
+	       (rdramSize - rdramBaseSize) >> rdramPageShift);
+	mem->expansionPak = present;
+	mem->size = size;
+}
+
+void
+markAllDirty()
+{
+	memset(mem->dirty, 0xff, sizeof(mem->dirty));
+}
+
+uint32_t
+collectDirty(DirtyConsumer consumer, uint16_t *pages)
+{
+	uint32_t count = 0;
+	uint32_t addressable = mem->size >> rdramPageShift;
+
+	/* Most pages are clean, so skip eight at a time where possible. */
+	for (uint32_t i = 0; i < addressable; i += 8) {
+		uint64_t flags;
+		memcpy(&flags, &mem->dirty[i], sizeof(flags));
+		if (!(flags & (0x0101010101010101ull * consumer))) {
+			continue;
+		}
+		for (uint32_t j = i; j < i + 8; j++) {
+			if (mem->dirty[j] & consumer) {
+				mem->dirty[j] &= ~consumer;
+				pages[count++] = (uint16_t)j;
+			}
+		}
+	}
+	return count;
+}
+
+void
+clearDirty(DirtyConsumer consumer)
+{
+	for (uint32_t i = 0; i < rdramPages; i++) {
+		mem->dirty[i] &= ~consumer;
+	}
+}
+
+/* How much of [addr, addr + size) is installed. */
+static uint32_t
+installed(uint32_t addr, uint32_t size)
+{
+	if (addr >= mem->size) {
+		return 0;
+	}
+	return size < mem->size - addr ? size : mem->size - addr;
+}
+
+void
+rdramReadBlock(uint32_t addr, uint8_t *dst, uint32_t size)
+{
+	addr &= rdramSize - 4;
+	uint32_t n = installed(addr, size);
+
+	swap32(dst, &mem->mem[addr], n);
+	memset(dst + n, 0, size - n);
+}
+
+void
+rdramWriteBlock(uint32_t addr, const uint8_t *src, uint32_t size)
+{
+	addr &= rdramSize - 4;
+	uint32_t n = installed(addr, size);
+
+	if (!n) {
+		return;
+	}
+	swap32(&mem->mem[addr], src, n);
+	memset(&mem->dirty[addr >> rdramPageShift], 0xff,
+	       ((addr + n - 1) >> rdramPageShift) - (addr >> rdramPageShift) + 1);
+}
@@ -27,29 +27,174 @@
 #pragma once
 
 #include <cstdint>
+#include <cstring>
 
+static const int rdramPageShift = 12;
+static const uint32_t rdramPageSize = 1 << rdramPageShift;
+/* With the Expansion Pak; the base console has half as much. */
+static const uint32_t rdramSize = 8388608;
+static const uint32_t rdramBaseSize = rdramSize / 2;
+static const uint32_t rdramPages = rdramSize >> rdramPageShift;
+
+/*
+ * Each RDRAM page has a byte of dirty flags, one bit per consumer. Guest
+ * writes set the whole byte; each consumer scans for and clears only its
+ * own bit, so they can sample changes at different rates.
+ */
+enum DirtyConsumer : uint8_t {
+	DirtyRewind = 1 << 0,
+	DirtyHash = 1 << 1,
+	DirtyIdle = 1 << 2,
+	DirtyDecode = 1 << 3,
+};
+
+/*
+ * mem reserves the full rdramSize bytes, but only the first size bytes
+ * are addressable. The reservation is committed by the host as pages are
+ * first touched, so a console without the Expansion Pak never pays for
+ * the upper half. Reads beyond size return zero and writes are dropped.
+ *
+ * guestOrder is a second reservation as large as mem, where save states
+ * put RDRAM into guest byte order before packing it, so taking one never
+ * writes to mem. It is only committed once something saves.
+ */
 struct Memory {
 	bool expansionPak;
-	uint8_t mem[8388608];
+	uint32_t size;
+	uint8_t *mem;
+	uint8_t *guestOrder;
+	uint8_t dirty[rdramPages];
 };
 
-extern Memory mem;
+extern thread_local Memory *mem;
 
-struct TLB {
+/*
+ * RDRAM is stored as host-order 32-bit words: the guest word at an
+ * aligned address is a plain uint32_t at mem + addr, so word accesses
+ * are a single host load or store, and narrower ones only flip address
+ * bits to find their lane. Blocks of guest-order bytes (DMA, save
+ * states) are converted a block at a time with swap32().
+ */
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+	      "RDRAM storage assumes a little-endian host");
 
-};
+static inline uint8_t
+rdramRead8(uint32_t addr)
+{
+	addr &= rdramSize - 1;
+	return addr < mem->size ? mem->mem[addr ^ 3] : 0;
+}
 
-struct MMURegister{
+static inline uint16_t
+rdramRead16(uint32_t addr)
+{
+	uint16_t value;
 
-};
+	addr &= rdramSize - 2;
+	if (addr >= mem->size) {
+		return 0;
+	}
+	memcpy(&value, &mem->mem[addr ^ 2], sizeof(value));
+	return value;
+}
+
+static inline uint32_t
+rdramRead32(uint32_t addr)
+{
+	uint32_t value;
+
+	addr &= rdramSize - 4;
+	if (addr >= mem->size) {
+		return 0;
+	}
+	memcpy(&value, &mem->mem[addr], sizeof(value));
+	return value;
+}
 
-#if 0
-uint8_t
-busread(uint32_t address)
+static inline uint64_t
+rdramRead64(uint32_t addr)
 {
-	switch (address) {
-	case 0x00000000 ... 0x03EFFFFF: /* RDRAM Memory */
+	return (uint64_t)rdramRead32(addr) << 32 | rdramRead32(addr + 4);
+}
 
+static inline void
+rdramWrite8(uint32_t addr, uint8_t value)
+{
+	addr &= rdramSize - 1;
+	if (addr >= mem->size) {
+		return;
 	}
+	mem->mem[addr ^ 3] = value;
+	mem->dirty[addr >> rdramPageShift] = 0xff;
 }
-#endif
+
+static inline void
+rdramWrite16(uint32_t addr, uint16_t value)
+{
+	addr &= rdramSize - 2;
+	if (addr >= mem->size) {
+		return;
+	}
+	memcpy(&mem->mem[addr ^ 2], &value, sizeof(value));
+	mem->dirty[addr >> rdramPageShift] = 0xff;
+}
+
+static inline void
+rdramWrite32(uint32_t addr, uint32_t value)
+{
+	addr &= rdramSize - 4;
+	if (addr >= mem->size) {
+		return;
+	}
+	memcpy(&mem->mem[addr], &value, sizeof(value));
+	mem->dirty[addr >> rdramPageShift] = 0xff;
+}
+
+static inline void
+rdramWrite64(uint32_t addr, uint64_t value)
+{
+	rdramWrite32(addr, (uint32_t)(value >> 32));
+	rdramWrite32(addr + 4, (uint32_t)value);
+}
+
+/*
+ * Copy size bytes between RDRAM and a guest-order buffer, for DMA. addr
+ * and size must be multiples of 4. Bytes beyond the installed memory
+ * read as zero and are not written.
+ */
+extern void
+rdramReadBlock(uint32_t addr, uint8_t *dst, uint32_t size);
+
+extern void
+rdramWriteBlock(uint32_t addr, const uint8_t *src, uint32_t size);
+
+/*
+ * Insert or remove the Expansion Pak. Removing it returns the upper 4 MiB
+ * to the host; it reads back as zero if the pak is inserted again.
+ */
+extern void
+rdramSetExpansionPak(bool present);
+
+/* Mark every page dirty, e.g. after RDRAM was replaced wholesale. */
+extern void
+markAllDirty();
+
+/*
+ * Collect the addressable pages dirty for one consumer into pages (which
+ * must hold rdramPages entries), clearing that consumer's bit. Returns
+ * the count.
+ */
+extern uint32_t
+collectDirty(DirtyConsumer consumer, uint16_t *pages);
+
+/* Clear one consumer's bit on every page without collecting them. */
+extern void
+clearDirty(DirtyConsumer consumer);
+
+struct TLB {
+
+};
+
+struct MMURegister{
+
+};
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "cpu.h"
+#include "mi.h"
+
+static const uint32_t miVersion = 0x02020102;
+
+void
+miRaise(MIInterrupt source)
+{
+	mi->intr |= source;
+	cpuCheckInterrupts();
+}
+
+void
+miClear(MIInterrupt source)
+{
+	mi->intr &= ~source;
+	cpuCheckInterrupts();
+}
+
+uint32_t
+miRead(uint32_t offset)
+{
+	switch (offset) {
+	case 0x00: /* MI_MODE */
+		return mi->mode;
+	case 0x04: /* MI_VERSION */
+		return miVersion;
+	case 0x08: /* MI_INTR */
+		return mi->intr;
+	case 0x0c: /* MI_MASK */
+		return mi->mask;
+	default:
+		return 0;
+	}
+}
+
+void
+miWrite(uint32_t offset, uint32_t value)
+{
+	switch (offset) {
+	case 0x00: /* MI_MODE */
+		mi->mode = (mi->mode & ~0x7f) | (value & 0x7f);
+		if (value & 0x800) {
+			miClear(MIInterruptDP);
+		}
+		break;
+	case 0x0c: /* MI_MASK, a clear/set bit pair per source */
+		for (int i = 0; i < 6; i++) {
+			if (value & (1 << (2 * i))) {
+				mi->mask &= ~(1u << i);
+			}
+			if (value & (1 << (2 * i + 1))) {
+				mi->mask |= 1u << i;
+			}
+		}
+		cpuCheckInterrupts();
+		break;
+	}
+}
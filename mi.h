@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+/* MI_INTR bits, one per RCP interrupt source. */
+enum MIInterrupt : uint32_t {
+	MIInterruptSP = 1 << 0,
+	MIInterruptSI = 1 << 1,
+	MIInterruptAI = 1 << 2,
+	MIInterruptVI = 1 << 3,
+	MIInterruptPI = 1 << 4,
+	MIInterruptDP = 1 << 5,
+};
+
+/* MIPS interface: the RCP's interrupt controller. */
+struct MIRegisters {
+	uint32_t mode;
+	uint32_t intr;
+	uint32_t mask;
+};
+
+extern thread_local MIRegisters *mi;
+
+extern void
+miRaise(MIInterrupt source);
+
+extern void
+miClear(MIInterrupt source);
+
+/* True if any unmasked RCP interrupt is pending (CPU IP2). */
+static inline bool
+miPending()
+{
+	return (mi->intr & mi->mask) != 0;
+}
+
+/* Register access at an offset into the MI register block. */
+extern uint32_t
+miRead(uint32_t offset);
+
+extern void
+miWrite(uint32_t offset, uint32_t value);
@@ -0,0 +1,753 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+#include "bits.h"
+#include "cpu.h"
+#include "fpu.h"
+#include "mem.h"
+#include "trace.h"
+
+/*
+ * The MIPS scalar core shared by the VR4300 and the RSP. Both run the
+ * same template code over a Core type that supplies the register file,
+ * the memory interface and whatever coprocessors it has:
+ *
+ *	pcMask		the bits of a return address the core keeps
+ *	mips3		64-bit operations and likely branches exist; if
+ *			not they decode as reserved instructions
+ *	hasFPU		COP1 and its loads and stores exist
+ *	hasCOP0Ops	ERET and the doubleword COP0 moves exist
+ *	traceCore	which core trace records are tagged with
+ *	exec()		the ExecState of the instruction being executed
+ *	regs()		the Registers to run on
+ *	read8..64()	data loads, write8..64() data stores, taking
+ *			virtual addresses
+ *	watch()		called before each load or store under the watch
+ *			policy (only needed by cores that use it)
+ *	readCOP0()	MFC0 and DMFC0, writeCOP0() MTC0 and DMTC0
+ *	exception()	raise a synchronous exception (may do nothing)
+ *	eret()		return from an exception
+ *	fetch<P>()	the pre-decoded instruction at pc, decoding it with
+ *			decode<Core, P>() if it is not cached yet
+ *
+ * Instructions are decoded once into a Decoded holding their fields and
+ * a pointer to a handler specialised for the core and policy, so the
+ * interpreter dispatches through one indirect call and never looks at
+ * the opcode again. Each core caches decoded instructions for its own
+ * memory and must drop them when the code, or the policy, changes.
+ */
+
+/*
+ * Interpreter policies. Every combination is compiled separately and
+ * the run loop is picked once, so none of these cost a test per
+ * instruction:
+ *
+ *	mode64		64-bit operations are legal (otherwise they raise a
+ *			reserved instruction exception, as in 32-bit user mode)
+ *	strictOverflow	ADD, ADDI, DADD and DADDI trap on signed overflow
+ *			instead of wrapping
+ *	trace		record each instruction and the registers it
+ *			changed to the thread's trace (see trace.h)
+ *	watch		loads and stores report their address to
+ *			Core::watch(), for the debugger's watchpoints
+ */
+template <bool Mode64, bool StrictOverflow, bool Trace, bool Watch>
+struct Policy {
+	static const bool mode64 = Mode64;
+	static const bool strictOverflow = StrictOverflow;
+	static const bool trace = Trace;
+	static const bool watch = Watch;
+};
+
+/* The instruction being executed, for exceptions raised part way. */
+struct ExecState {
+	uint64_t currentPC;
+	bool inDelaySlot;
+};
+
+struct Decoded {
+	void (*handler)(const Decoded &d);
+	uint32_t opcode;
+	uint8_t rs;
+	uint8_t rt;
+	uint8_t rd;
+	uint8_t sa;
+	/* Sign-extended immediate, or the 26-bit jump target */
+	int64_t imm;
+};
+
+static const uint32_t decodedPerPage = rdramPageSize / 4;
+
+/* Per-instance interpreter state of each core. */
+struct VR4300State {
+	ExecState exec;
+	/* The configured policy and its run loop */
+	CPUOptions options;
+	void (*run)(uint64_t until);
+	/*
+	 * Decoded instructions for all of RDRAM, decodedPerPage per page.
+	 * It lives in the instance's arena, so pages that never hold code
+	 * are never committed; decodedUsed marks the ones that might.
+	 */
+	Decoded *decoded;
+	bool decodedUsed[rdramPages];
+	/* WatchConsumer bits per page, and cpuWatch() references */
+	uint8_t watchPages[rdramPages];
+	unsigned watchUsers;
+};
+
+struct RSPState {
+	ExecState exec;
+	void (*run)(uint64_t instructions);
+	/* One entry per IMEM word */
+	Decoded decoded[1024];
+};
+
+namespace mips {
+
+/*
+ * Branches do not jump directly: they redirect nextPC, so the pipeline
+ * runs the delay slot before the target. step() sets pc to nextPC before
+ * executing, so while an instruction runs pc and nextPC are the two that
+ * follow it, and delaySlot says whether pc is a delay slot.
+ */
+template <class Core>
+static inline void
+branch(bool taken, uint64_t target)
+{
+	Registers &r = Core::regs();
+
+	r.delaySlot = true;
+	if (taken) {
+		r.nextPC = target;
+	}
+}
+
+/* Likely branches annul the delay slot when not taken. */
+template <class Core>
+static inline void
+branchLikely(bool taken, uint64_t target)
+{
+	Registers &r = Core::regs();
+
+	if (taken) {
+		r.delaySlot = true;
+		r.nextPC = target;
+	} else {
+		r.pc = r.nextPC;
+		r.nextPC += 4;
+	}
+}
+
+template <class Core>
+static inline uint64_t
+offsetTarget(const Decoded &d)
+{
+	return Core::exec().currentPC + 4 + d.imm * 4;
+}
+
+template <class Core>
+static inline uint64_t
+jumpTarget(const Decoded &d)
+{
+	return ((Core::exec().currentPC + 4) & ~0x0fffffffull) | d.imm << 2;
+}
+
+template <class Core>
+static inline uint64_t
+link()
+{
+	return (Core::exec().currentPC + 8) & Core::pcMask;
+}
+
+template <class Core>
+static inline uint64_t
+address(const Decoded &d)
+{
+	return Core::regs().gpr[d.rs] + d.imm;
+}
+
+/* The address of a load or store of size bytes, reported if watched. */
+template <class Core, class P>
+static inline uint64_t
+access(const Decoded &d, int size, bool write)
+{
+	uint64_t vaddr = address<Core>(d);
+	if constexpr (P::watch) {
+		Core::watch(vaddr, size, write);
+	}
+	return vaddr;
+}
+
+/* Signed add that traps on overflow under a strict policy. */
+template <class Core, class P>
+static inline void
+add32(uint64_t a, uint64_t b, uint64_t &result)
+{
+	int32_t sum;
+	if (P::strictOverflow &&
+	    __builtin_add_overflow((int32_t)a, (int32_t)b, &sum)) {
+		Core::exception(ExcOverflow);
+		return;
+	}
+	result = signExtend<32>((uint32_t)a + (uint32_t)b);
+}
+
+template <class Core, class P>
+static inline void
+add64(uint64_t a, uint64_t b, uint64_t &result)
+{
+	int64_t sum;
+	if (P::strictOverflow &&
+	    __builtin_add_overflow((int64_t)a, (int64_t)b, &sum)) {
+		Core::exception(ExcOverflow);
+		return;
+	}
+	result = a + b;
+}
+
+/* 64-bit operations without mode64 are reserved instructions. */
+template <class Core, class P>
+static inline bool
+allow64()
+{
+	if constexpr (!P::mode64) {
+		Core::exception(ExcReserved);
+		return false;
+	}
+	return true;
+}
+
+#define GPR(i) Core::regs().gpr[i]
+/* Not every handler needs its operands */
+#define HANDLER(name)                  \
+	template <class Core, class P> \
+	static void name([[maybe_unused]] const Decoded &d)
+
+/*
+ * Not emulated yet. Runs as a nop so games limp on, but says so the
+ * first time each instruction (by opcode and SPECIAL or REGIMM function)
+ * turns up, so a loop does not flood the log.
+ */
+HANDLER(opUnknown)
+{
+	static thread_local bool reported[64 + 64 + 32];
+
+	uint32_t op = bitField<26, 6>(d.opcode);
+	uint32_t kind = op == 0 ? 64 + bitField<0, 6>(d.opcode)
+			: op == 1 ? 128 + d.rt
+				  : op;
+	if (!reported[kind]) {
+		reported[kind] = true;
+		fprintf(stderr, "%s: unknown opcode %08x at %llx\n",
+			Core::mips3 ? "cpu" : "rsp", d.opcode,
+			(unsigned long long)Core::exec().currentPC);
+	}
+}
+
+HANDLER(opReserved)
+{
+	Core::exception(ExcReserved);
+}
+
+HANDLER(opADD)
+{
+	add32<Core, P>(GPR(d.rs), GPR(d.rt), GPR(d.rd));
+}
+
+HANDLER(opADDU)
+{
+	GPR(d.rd) = signExtend<32>((uint32_t)(GPR(d.rs) + GPR(d.rt)));
+}
+
+HANDLER(opAND)
+{
+	GPR(d.rd) = GPR(d.rs) & GPR(d.rt);
+}
+
+HANDLER(opDADD)
+{
+	if (allow64<Core, P>()) {
+		add64<Core, P>(GPR(d.rs), GPR(d.rt), GPR(d.rd));
+	}
+}
+
+HANDLER(opDADDU)
+{
+	if (allow64<Core, P>()) {
+		GPR(d.rd) = GPR(d.rs) + GPR(d.rt);
+	}
+}
+
+HANDLER(opJR)
+{
+	branch<Core>(true, GPR(d.rs));
+}
+
+HANDLER(opJALR)
+{
+	uint64_t target = GPR(d.rs);
+	GPR(d.rd) = link<Core>();
+	branch<Core>(true, target);
+}
+
+HANDLER(opBREAK)
+{
+	Core::exception(ExcBreakpoint);
+}
+
+HANDLER(opADDI)
+{
+	add32<Core, P>(GPR(d.rs), d.imm, GPR(d.rt));
+}
+
+HANDLER(opADDIU)
+{
+	GPR(d.rt) = signExtend<32>((uint32_t)(GPR(d.rs) + d.imm));
+}
+
+HANDLER(opANDI)
+{
+	GPR(d.rt) = GPR(d.rs) & (uint16_t)d.imm;
+}
+
+HANDLER(opDADDI)
+{
+	if (allow64<Core, P>()) {
+		add64<Core, P>(GPR(d.rs), d.imm, GPR(d.rt));
+	}
+}
+
+HANDLER(opDADDIU)
+{
+	if (allow64<Core, P>()) {
+		GPR(d.rt) = GPR(d.rs) + d.imm;
+	}
+}
+
+HANDLER(opMFC0)
+{
+	GPR(d.rt) = signExtend<32>(Core::readCOP0(d.rd));
+}
+
+HANDLER(opDMFC0)
+{
+	GPR(d.rt) = Core::readCOP0(d.rd);
+}
+
+HANDLER(opMTC0)
+{
+	Core::writeCOP0(d.rd, (int32_t)GPR(d.rt));
+}
+
+HANDLER(opDMTC0)
+{
+	Core::writeCOP0(d.rd, GPR(d.rt));
+}
+
+HANDLER(opERET)
+{
+	Core::eret();
+}
+
+HANDLER(opBC1)
+{
+	if (!fpuUsable()) {
+		return;
+	}
+	bool taken = fpuCondition() == (d.rt & 1);
+	if (d.rt & 0b00000010) { /* BC1FL, BC1TL */
+		branchLikely<Core>(taken, offsetTarget<Core>(d));
+	} else {
+		branch<Core>(taken, offsetTarget<Core>(d));
+	}
+}
+
+HANDLER(opCOP1)
+{
+	/* MFC1, CFC1, arithmetic, ... */
+	execCOP1(d.opcode);
+}
+
+HANDLER(opJ)
+{
+	branch<Core>(true, jumpTarget<Core>(d));
+}
+
+HANDLER(opJAL)
+{
+	GPR(31) = link<Core>();
+	branch<Core>(true, jumpTarget<Core>(d));
+}
+
+HANDLER(opBEQ)
+{
+	branch<Core>(GPR(d.rs) == GPR(d.rt), offsetTarget<Core>(d));
+}
+
+HANDLER(opBEQL)
+{
+	branchLikely<Core>(GPR(d.rs) == GPR(d.rt), offsetTarget<Core>(d));
+}
+
+HANDLER(opBNE)
+{
+	branch<Core>(GPR(d.rs) != GPR(d.rt), offsetTarget<Core>(d));
+}
+
+HANDLER(opBNEL)
+{
+	branchLikely<Core>(GPR(d.rs) != GPR(d.rt), offsetTarget<Core>(d));
+}
+
+HANDLER(opBGEZ)
+{
+	branch<Core>((int64_t)GPR(d.rs) >= 0, offsetTarget<Core>(d));
+}
+
+HANDLER(opBGEZL)
+{
+	branchLikely<Core>((int64_t)GPR(d.rs) >= 0, offsetTarget<Core>(d));
+}
+
+HANDLER(opBGEZAL)
+{
+	bool taken = (int64_t)GPR(d.rs) >= 0;
+	GPR(31) = link<Core>();
+	branch<Core>(taken, offsetTarget<Core>(d));
+}
+
+HANDLER(opBGEZALL)
+{
+	bool taken = (int64_t)GPR(d.rs) >= 0;
+	GPR(31) = link<Core>();
+	branchLikely<Core>(taken, offsetTarget<Core>(d));
+}
+
+HANDLER(opBLTZ)
+{
+	branch<Core>((int64_t)GPR(d.rs) < 0, offsetTarget<Core>(d));
+}
+
+HANDLER(opBLTZL)
+{
+	branchLikely<Core>((int64_t)GPR(d.rs) < 0, offsetTarget<Core>(d));
+}
+
+HANDLER(opBLTZAL)
+{
+	bool taken = (int64_t)GPR(d.rs) < 0;
+	GPR(31) = link<Core>();
+	branch<Core>(taken, offsetTarget<Core>(d));
+}
+
+HANDLER(opBLTZALL)
+{
+	bool taken = (int64_t)GPR(d.rs) < 0;
+	GPR(31) = link<Core>();
+	branchLikely<Core>(taken, offsetTarget<Core>(d));
+}
+
+HANDLER(opBGTZ)
+{
+	branch<Core>((int64_t)GPR(d.rs) > 0, offsetTarget<Core>(d));
+}
+
+HANDLER(opBGTZL)
+{
+	branchLikely<Core>((int64_t)GPR(d.rs) > 0, offsetTarget<Core>(d));
+}
+
+HANDLER(opBLEZ)
+{
+	branch<Core>((int64_t)GPR(d.rs) <= 0, offsetTarget<Core>(d));
+}
+
+HANDLER(opBLEZL)
+{
+	branchLikely<Core>((int64_t)GPR(d.rs) <= 0, offsetTarget<Core>(d));
+}
+
+HANDLER(opCACHE)
+{
+	/*
+	 * Deliberately a no-op: neither cache is emulated and every access
+	 * goes straight to memory, so there is never anything to write
+	 * back, invalidate or fill.
+	 */
+}
+
+HANDLER(opLB)
+{
+	GPR(d.rt) = signExtend<8>(Core::read8(access<Core, P>(d, 1, false)));
+}
+
+HANDLER(opLBU)
+{
+	GPR(d.rt) = Core::read8(access<Core, P>(d, 1, false));
+}
+
+HANDLER(opLH)
+{
+	GPR(d.rt) = signExtend<16>(Core::read16(access<Core, P>(d, 2, false)));
+}
+
+HANDLER(opLHU)
+{
+	GPR(d.rt) = Core::read16(access<Core, P>(d, 2, false));
+}
+
+HANDLER(opLW)
+{
+	GPR(d.rt) = signExtend<32>(Core::read32(access<Core, P>(d, 4, false)));
+}
+
+HANDLER(opLWU)
+{
+	GPR(d.rt) = Core::read32(access<Core, P>(d, 4, false));
+}
+
+HANDLER(opLD)
+{
+	if (allow64<Core, P>()) {
+		GPR(d.rt) = Core::read64(access<Core, P>(d, 8, false));
+	}
+}
+
+HANDLER(opSB)
+{
+	Core::write8(access<Core, P>(d, 1, true), (uint8_t)GPR(d.rt));
+}
+
+HANDLER(opSH)
+{
+	Core::write16(access<Core, P>(d, 2, true), (uint16_t)GPR(d.rt));
+}
+
+HANDLER(opSW)
+{
+	Core::write32(access<Core, P>(d, 4, true), (uint32_t)GPR(d.rt));
+}
+
+HANDLER(opSD)
+{
+	if (allow64<Core, P>()) {
+		Core::write64(access<Core, P>(d, 8, true), GPR(d.rt));
+	}
+}
+
+HANDLER(opLWC1)
+{
+	if (fpuUsable()) {
+		setFgr32(d.rt, Core::read32(access<Core, P>(d, 4, false)));
+	}
+}
+
+HANDLER(opLDC1)
+{
+	if (fpuUsable()) {
+		setFgr64(d.rt, Core::read64(access<Core, P>(d, 8, false)));
+	}
+}
+
+HANDLER(opSWC1)
+{
+	if (fpuUsable()) {
+		Core::write32(access<Core, P>(d, 4, true), fgr32(d.rt));
+	}
+}
+
+HANDLER(opSDC1)
+{
+	if (fpuUsable()) {
+		Core::write64(access<Core, P>(d, 8, true), fgr64(d.rt));
+	}
+}
+
+#undef HANDLER
+#undef GPR
+
+} /* namespace mips */
+
+/* Decode one instruction for the given core and policy. */
+template <class Core, class P>
+static Decoded
+decode(uint32_t opcode)
+{
+	using namespace mips;
+
+	Decoded d;
+	d.opcode = opcode;
+	d.rs = bitField<21, 5>(opcode);
+	d.rt = bitField<16, 5>(opcode);
+	d.rd = bitField<11, 5>(opcode);
+	d.sa = bitField<6, 5>(opcode);
+	d.imm = signExtend<16>(opcode);
+
+#define OP(mnemonic) d.handler = op##mnemonic<Core, P>
+#define OP3(mnemonic)                                     \
+	do {                                              \
+		if constexpr (Core::mips3) {              \
+			OP(mnemonic);                     \
+		} else {                                  \
+			d.handler = opReserved<Core, P>;  \
+		}                                         \
+	} while (0)
+
+	d.handler = opUnknown<Core, P>;
+
+	switch (bitField<26, 6>(opcode)) {
+	case 0b000000:
+		switch (opcode & 63) {
+		case 0b100000: OP(ADD); break;
+		case 0b100001: OP(ADDU); break;
+		case 0b100100: OP(AND); break;
+		case 0b101100: OP3(DADD); break;
+		case 0b101101: OP3(DADDU); break;
+		case 0b001000: OP(JR); break;
+		case 0b001001: OP(JALR); break;
+		case 0b001101: OP(BREAK); break;
+		}
+		break;
+	case 0b000001:
+		switch (d.rt) {
+		case 0b00000: OP(BLTZ); break;
+		case 0b00001: OP(BGEZ); break;
+		case 0b00010: OP3(BLTZL); break;
+		case 0b00011: OP3(BGEZL); break;
+		case 0b10000: OP(BLTZAL); break;
+		case 0b10001: OP(BGEZAL); break;
+		case 0b10010: OP3(BLTZALL); break;
+		case 0b10011: OP3(BGEZALL); break;
+		}
+		break;
+	case 0b000010: OP(J); d.imm = bitField<0, 26>(opcode); break;
+	case 0b000011: OP(JAL); d.imm = bitField<0, 26>(opcode); break;
+	case 0b000100: OP(BEQ); break;
+	case 0b000101: OP(BNE); break;
+	case 0b000110: OP(BLEZ); break;
+	case 0b000111: OP(BGTZ); break;
+	case 0b001000: OP(ADDI); break;
+	case 0b001001: OP(ADDIU); break;
+	case 0b001100: OP(ANDI); break;
+	case 0b010000:
+		switch (d.rs) {
+		case 0b00000: OP(MFC0); break;
+		case 0b00100: OP(MTC0); break;
+		}
+		if constexpr (Core::hasCOP0Ops) {
+			switch (d.rs) {
+			case 0b00001: OP(DMFC0); break;
+			case 0b00101: OP(DMTC0); break;
+			case 0b10000:
+				if ((opcode & 63) == 0b011000) {
+					OP(ERET);
+				}
+				break;
+			}
+		}
+		break;
+	case 0b010001:
+		if constexpr (Core::hasFPU) {
+			if (d.rs == 0b01000) {
+				OP(BC1);
+			} else {
+				OP(COP1);
+			}
+		}
+		break;
+	case 0b010100: OP3(BEQL); break;
+	case 0b010101: OP3(BNEL); break;
+	case 0b010110: OP3(BLEZL); break;
+	case 0b010111: OP3(BGTZL); break;
+	case 0b011000: OP3(DADDI); break;
+	case 0b011001: OP3(DADDIU); break;
+	case 0b100000: OP(LB); break;
+	case 0b100001: OP(LH); break;
+	case 0b100011: OP(LW); break;
+	case 0b100100: OP(LBU); break;
+	case 0b100101: OP(LHU); break;
+	case 0b100111: OP3(LWU); break;
+	case 0b101000: OP(SB); break;
+	case 0b101001: OP(SH); break;
+	case 0b101011: OP(SW); break;
+	case 0b101111: OP(CACHE); break;
+	case 0b110001:
+		if constexpr (Core::hasFPU) {
+			OP(LWC1);
+		}
+		break;
+	case 0b110101:
+		if constexpr (Core::hasFPU) {
+			OP(LDC1);
+		}
+		break;
+	case 0b110111: OP3(LD); break;
+	case 0b111001:
+		if constexpr (Core::hasFPU) {
+			OP(SWC1);
+		}
+		break;
+	case 0b111101:
+		if constexpr (Core::hasFPU) {
+			OP(SDC1);
+		}
+		break;
+	case 0b111111: OP3(SD); break;
+	}
+
+#undef OP3
+#undef OP
+
+	return d;
+}
+
+/* Execute the instruction at pc. */
+template <class Core, class P>
+static inline void
+step()
+{
+	Registers &r = Core::regs();
+	ExecState &e = Core::exec();
+
+	e.currentPC = r.pc;
+	e.inDelaySlot = r.delaySlot;
+	r.pc = r.nextPC;
+	r.nextPC += 4;
+	r.delaySlot = false;
+
+	const Decoded &d = Core::template fetch<P>(e.currentPC);
+	d.handler(d);
+	r.gpr[0] = 0;
+	if constexpr (P::trace) {
+		traceInstruction(Core::traceCore, e.currentPC, d.opcode, r);
+	}
+}
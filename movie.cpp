@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "emulator.h"
+#include "movie.h"
+#include "savestate.h"
+#include "statehash.h"
+
+static void
+write32(uint32_t v)
+{
+	fwrite(&v, sizeof(v), 1, emu->movie.file);
+}
+
+static bool
+read(void *out, size_t size)
+{
+	MovieState &m = emu->movie;
+
+	if (m.data.size() - m.pos < size) {
+		return false;
+	}
+	memcpy(out, &m.data[m.pos], size);
+	m.pos += size;
+	return true;
+}
+
+bool
+movieRecord(const char *path, uint32_t checkpointInterval)
+{
+	MovieState &m = emu->movie;
+
+	movieStop();
+
+	std::vector<uint8_t> state(saveStateBound());
+	size_t size = saveState(state.data(), state.size());
+	if (!size) {
+		return false;
+	}
+	m.file = fopen(path, "wb");
+	if (!m.file) {
+		return false;
+	}
+
+	write32(movieMagic);
+	write32(movieVersion);
+	write32(checkpointInterval);
+	write32((uint32_t)size);
+	fwrite(state.data(), 1, size, m.file);
+
+	m.interval = checkpointInterval;
+	m.polls = 0;
+	m.divergence = -1;
+	m.mode = MovieRecording;
+	return true;
+}
+
+bool
+moviePlay(const char *path)
+{
+	MovieState &m = emu->movie;
+
+	movieStop();
+
+	FILE *in = fopen(path, "rb");
+	if (!in) {
+		return false;
+	}
+	long size = -1;
+	if (fseek(in, 0, SEEK_END) == 0) {
+		size = ftell(in);
+	}
+	if (size < 0 || fseek(in, 0, SEEK_SET) != 0) {
+		fclose(in);
+		return false;
+	}
+	m.data.resize(size);
+	bool ok = fread(m.data.data(), 1, m.data.size(), in) == m.data.size();
+	fclose(in);
+	m.pos = 0;
+
+	uint32_t magic, version, stateSize;
+	ok = ok && read(&magic, 4) && read(&version, 4) &&
+	     read(&m.interval, 4) && read(&stateSize, 4);
+	if (!ok || magic != movieMagic || version != movieVersion ||
+	    m.data.size() - m.pos < stateSize) {
+		return false;
+	}
+	if (!loadState(&m.data[m.pos], stateSize)) {
+		return false;
+	}
+	m.pos += stateSize;
+
+	m.polls = 0;
+	m.divergence = -1;
+	m.mode = MoviePlaying;
+	return true;
+}
+
+void
+movieStop()
+{
+	MovieState &m = emu->movie;
+
+	if (m.file) {
+		fclose(m.file);
+		m.file = nullptr;
+	}
+	m.data.clear();
+	m.mode = MovieOff;
+}
+
+MovieMode
+movieMode()
+{
+	return emu->movie.mode;
+}
+
+uint64_t
+moviePolls()
+{
+	return emu->movie.polls;
+}
+
+int64_t
+movieDivergence()
+{
+	return emu->movie.divergence;
+}
+
+static void
+diverged()
+{
+	MovieState &m = emu->movie;
+
+	m.divergence = (int64_t)m.polls;
+	fprintf(stderr, "movie: replay diverged at poll %llu\n",
+		(unsigned long long)m.polls);
+	movieStop();
+}
+
+static void
+recordInput(int port, const ControllerState &state)
+{
+	MovieState &m = emu->movie;
+
+	fputc('I', m.file);
+	fputc(port, m.file);
+	fwrite(&state.buttons, sizeof(state.buttons), 1, m.file);
+	fputc((uint8_t)state.stickX, m.file);
+	fputc((uint8_t)state.stickY, m.file);
+
+	m.polls++;
+	if (m.interval && m.polls % m.interval == 0) {
+		uint64_t h = stateHash();
+		fputc('C', m.file);
+		fwrite(&h, sizeof(h), 1, m.file);
+	}
+}
+
+static void
+playInput(int port, ControllerState &state)
+{
+	MovieState &m = emu->movie;
+
+	uint8_t tag, recPort;
+
+	if (m.pos == m.data.size()) {
+		/* Ran out of input: the replay finished cleanly. */
+		movieStop();
+		return;
+	}
+	if (!read(&tag, 1) || tag != 'I' || !read(&recPort, 1) ||
+	    recPort != port || !read(&state.buttons, 2) ||
+	    !read(&state.stickX, 1) || !read(&state.stickY, 1)) {
+		diverged();
+		return;
+	}
+
+	m.polls++;
+	if (m.interval && m.polls % m.interval == 0) {
+		uint64_t expected;
+		if (!read(&tag, 1) || tag != 'C' || !read(&expected, 8) ||
+		    expected != stateHash()) {
+			diverged();
+		}
+	}
+}
+
+void
+movieInput(int port, ControllerState &state)
+{
+	MovieState &m = emu->movie;
+
+	if (m.mode == MovieRecording) {
+		recordInput(port, state);
+	} else if (m.mode == MoviePlaying) {
+		playInput(port, state);
+	}
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "input.h"
+
+/*
+ * Movies are input logs for bit-exact replays. A movie file is:
+ *
+ *   u32 magic, u32 version, u32 checkpoint interval,
+ *   u32 state size, a full save state to start from,
+ *   then one record per controller poll:
+ *     'I' u8 port, u16 buttons, s8 stick x, s8 stick y
+ *   and after every interval-th poll a checkpoint:
+ *     'C' u64 state hash
+ *
+ * During playback each checkpoint is compared against the live state, so
+ * a divergence is reported at the poll where it first shows up instead of
+ * at the end of the run.
+ */
+
+static const uint32_t movieMagic = 0x4d34364e; /* "N64M" */
+static const uint32_t movieVersion = 1;
+
+enum MovieMode {
+	MovieOff,
+	MovieRecording,
+	MoviePlaying,
+};
+
+struct MovieState {
+	MovieMode mode = MovieOff;
+	FILE *file = nullptr;
+	/* The whole movie while playing, and the read position in it */
+	std::vector<uint8_t> data;
+	size_t pos = 0;
+	uint32_t interval = 0;
+	uint64_t polls = 0;
+	int64_t divergence = -1;
+};
+
+/* Snapshot the current state and start logging polls to path. */
+extern bool
+movieRecord(const char *path, uint32_t checkpointInterval);
+
+/* Load path, restore its starting state and start feeding its inputs. */
+extern bool
+moviePlay(const char *path);
+
+/* Finish recording (flushing the file) or abandon playback. */
+extern void
+movieStop();
+
+extern MovieMode
+movieMode();
+
+/* Polls recorded or played back so far. */
+extern uint64_t
+moviePolls();
+
+/*
+ * Poll index at which playback diverged from the recording, or -1. Once
+ * set, playback has stopped.
+ */
+extern int64_t
+movieDivergence();
+
+/*
+ * Called by pollController() for each poll. While recording, logs state;
+ * while playing, replaces state with the recorded input.
+ */
+extern void
+movieInput(int port, ControllerState &state);
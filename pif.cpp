@@ -0,0 +1,331 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include "input.h"
+#include "mem.h"
+#include "mi.h"
+#include "pif.h"
+#include "timeline.h"
+#include "timers.h"
+
+static const uint32_t siStatusInterrupt = 1 << 12;
+
+/* Joybus rx length byte error flags. */
+static const uint8_t joybusNoDevice = 0x80;
+
+static const int eepromChannel = 4;
+
+/* CRC over a controller pak data block, polynomial 0x85. */
+static uint8_t
+pakDataCRC(const uint8_t *data)
+{
+	uint8_t crc = 0;
+
+	for (int i = 0; i <= 32; i++) {
+		for (int mask = 0x80; mask; mask >>= 1) {
+			uint8_t tap = (crc & 0x80) ? 0x85 : 0;
+			crc <<= 1;
+			if (i < 32 && (data[i] & mask)) {
+				crc |= 1;
+			}
+			crc ^= tap;
+		}
+	}
+	return crc;
+}
+
+static bool
+controllerCommand(int port, const uint8_t *cmd, int tx, uint8_t *resp, int rx)
+{
+	switch (cmd[0]) {
+	case 0x00: /* Status */
+	case 0xff: /* Reset */
+		if (rx < 3) {
+			return false;
+		}
+		resp[0] = 0x05;
+		resp[1] = 0x00;
+		resp[2] = pif->pakInserted[port] ? 0x01 : 0x02;
+		return true;
+	case 0x01: { /* Read buttons */
+		if (rx < 4) {
+			return false;
+		}
+		/* Sampled here, as late as the game allows. */
+		ControllerState state = pollController(port);
+		resp[0] = (uint8_t)(state.buttons >> 8);
+		resp[1] = (uint8_t)state.buttons;
+		resp[2] = (uint8_t)state.stickX;
+		resp[3] = (uint8_t)state.stickY;
+		return true;
+	}
+	case 0x02: { /* Pak read */
+		if (tx < 3 || rx < 33 || !pif->pakInserted[port]) {
+			return false;
+		}
+		uint32_t addr = (cmd[1] << 8 | cmd[2]) & ~0x1f;
+		if (addr < sizeof(pif->pak[port])) {
+			memcpy(resp, &pif->pak[port][addr], 32);
+		} else {
+			memset(resp, 0, 32);
+		}
+		resp[32] = pakDataCRC(resp);
+		return true;
+	}
+	case 0x03: { /* Pak write */
+		if (tx < 35 || rx < 1 || !pif->pakInserted[port]) {
+			return false;
+		}
+		uint32_t addr = (cmd[1] << 8 | cmd[2]) & ~0x1f;
+		if (addr < sizeof(pif->pak[port])) {
+			memcpy(&pif->pak[port][addr], &cmd[3], 32);
+		}
+		resp[0] = pakDataCRC(&cmd[3]);
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
+static bool
+eepromCommand(const uint8_t *cmd, int tx, uint8_t *resp, int rx)
+{
+	uint32_t size = eepromBytes(pif->eepromType);
+
+	if (pif->eepromType == EEPROMNone) {
+		return false;
+	}
+
+	switch (cmd[0]) {
+	case 0x00: /* Status */
+	case 0xff: /* Reset */
+		if (rx < 3) {
+			return false;
+		}
+		resp[0] = 0x00;
+		resp[1] = pif->eepromType == EEPROM16K ? 0xc0 : 0x80;
+		resp[2] = 0x00;
+		return true;
+	case 0x04: /* Read block */
+		if (tx < 2 || rx < 8) {
+			return false;
+		}
+		memcpy(resp, &pif->eeprom[(cmd[1] * 8) % size], 8);
+		return true;
+	case 0x05: /* Write block */
+		if (tx < 10 || rx < 1) {
+			return false;
+		}
+		memcpy(&pif->eeprom[(cmd[1] * 8) % size], &cmd[2], 8);
+		resp[0] = 0x00;
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* Walk the joybus command blocks in PIF RAM, one channel at a time. */
+static void
+runJoybus()
+{
+	int channel = 0;
+	int i = 0;
+
+	while (i < 63) {
+		uint8_t t = pif->ram[i];
+		if (t == 0xfe) { /* End of commands */
+			break;
+		}
+		if (t == 0x00) { /* Skip channel */
+			channel++;
+			i++;
+			continue;
+		}
+		if (t & 0x80) { /* Padding */
+			i++;
+			continue;
+		}
+
+		int tx = t & 0x3f;
+		int rx = pif->ram[i + 1] & 0x3f;
+		if (i + 2 + tx + rx > 63) {
+			break;
+		}
+		uint8_t *cmd = &pif->ram[i + 2];
+		uint8_t *resp = cmd + tx;
+
+		bool ok = false;
+		if (tx > 0) {
+			if (channel < 4) {
+				ok = controllerCommand(channel, cmd, tx, resp,
+						       rx);
+			} else if (channel == eepromChannel) {
+				ok = eepromCommand(cmd, tx, resp, rx);
+			}
+		}
+		if (!ok) {
+			pif->ram[i + 1] |= joybusNoDevice;
+		}
+
+		i += 2 + tx + rx;
+		channel++;
+	}
+
+	pif->ram[63] &= ~0x01;
+}
+
+/* SI DMA is instantaneous for now; it completes and interrupts at once. */
+static void
+dmaFinished()
+{
+	pif->siStatus |= siStatusInterrupt;
+	miRaise(MIInterruptSI);
+}
+
+uint32_t
+siRead(uint32_t offset)
+{
+	switch (offset) {
+	case 0x00: /* SI_DRAM_ADDR */
+		return pif->siDramAddr;
+	case 0x18: /* SI_STATUS */
+		return pif->siStatus;
+	default:
+		return 0;
+	}
+}
+
+void
+siWrite(uint32_t offset, uint32_t value)
+{
+	switch (offset) {
+	case 0x00: /* SI_DRAM_ADDR */
+		pif->siDramAddr = value & 0x00fffff8;
+		break;
+	case 0x04: { /* SI_PIF_ADDR_RD64B: PIF RAM -> RDRAM */
+		TIMER_SCOPE(TimerDMA);
+		TIMELINE_SPAN("si dma");
+		/*
+		 * Joybus runs here rather than on the preceding write so
+		 * controllers are sampled at the last possible moment.
+		 */
+		if (pif->ram[63] & 0x01) {
+			runJoybus();
+		}
+		rdramWriteBlock(pif->siDramAddr, pif->ram, sizeof(pif->ram));
+		dmaFinished();
+		break;
+	}
+	case 0x10: { /* SI_PIF_ADDR_WR64B: RDRAM -> PIF RAM */
+		TIMER_SCOPE(TimerDMA);
+		TIMELINE_SPAN("si dma");
+		rdramReadBlock(pif->siDramAddr, pif->ram, sizeof(pif->ram));
+		dmaFinished();
+		break;
+	}
+	case 0x18: /* SI_STATUS: any write acknowledges the interrupt */
+		pif->siStatus &= ~siStatusInterrupt;
+		miClear(MIInterruptSI);
+		break;
+	}
+}
+
+uint32_t
+pifRead32(uint32_t offset)
+{
+	offset &= sizeof(pif->ram) - 4;
+	return (uint32_t)pif->ram[offset] << 24 |
+	       (uint32_t)pif->ram[offset + 1] << 16 |
+	       (uint32_t)pif->ram[offset + 2] << 8 | pif->ram[offset + 3];
+}
+
+void
+pifWrite32(uint32_t offset, uint32_t value)
+{
+	offset &= sizeof(pif->ram) - 4;
+	pif->ram[offset] = (uint8_t)(value >> 24);
+	pif->ram[offset + 1] = (uint8_t)(value >> 16);
+	pif->ram[offset + 2] = (uint8_t)(value >> 8);
+	pif->ram[offset + 3] = (uint8_t)value;
+}
+
+/* Read exactly size bytes of path into data, which starts out blank. */
+static bool
+readImage(const char *path, uint8_t *data, size_t size)
+{
+	memset(data, 0, size);
+
+	FILE *file = fopen(path, "rb");
+	if (!file) {
+		/* Nothing saved yet; the file is created on save */
+		return errno == ENOENT;
+	}
+	bool ok = fread(data, 1, size, file) == size && fgetc(file) == EOF;
+	fclose(file);
+	return ok;
+}
+
+static bool
+writeImage(const char *path, const uint8_t *data, size_t size)
+{
+	FILE *file = fopen(path, "wb");
+	if (!file) {
+		return false;
+	}
+	bool ok = fwrite(data, 1, size, file) == size;
+	return fclose(file) == 0 && ok;
+}
+
+bool
+pifLoadEEPROM(EEPROMType type, const char *path)
+{
+	pif->eepromType = type;
+	return readImage(path, pif->eeprom, eepromBytes(type));
+}
+
+bool
+pifLoadPak(int port, const char *path)
+{
+	pif->pakInserted[port] = true;
+	return readImage(path, pif->pak[port], sizeof(pif->pak[port]));
+}
+
+bool
+pifSaveEEPROM(const char *path)
+{
+	return writeImage(path, pif->eeprom, eepromBytes(pif->eepromType));
+}
+
+bool
+pifSavePak(int port, const char *path)
+{
+	return writeImage(path, pif->pak[port], sizeof(pif->pak[port]));
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+enum EEPROMType : uint8_t {
+	EEPROMNone,
+	EEPROM4K,
+	EEPROM16K,
+};
+
+/*
+ * The PIF and the serial interface in front of it. The CPU moves the
+ * 64-byte PIF RAM to and from RDRAM with SI DMA; PIF RAM holds joybus
+ * command blocks for the four controller ports and the cartridge EEPROM.
+ */
+struct PIF {
+	uint8_t ram[64];
+	uint32_t siDramAddr;
+	uint32_t siStatus;
+	EEPROMType eepromType;
+	uint8_t eeprom[2048];
+	bool pakInserted[4];
+	uint8_t pak[4][32768];
+};
+
+extern thread_local PIF *pif;
+
+static inline uint32_t
+eepromBytes(EEPROMType type)
+{
+	return type == EEPROM16K ? 2048 : type == EEPROM4K ? 512 : 0;
+}
+
+/* SI register access at an offset into the SI register block. */
+extern uint32_t
+siRead(uint32_t offset);
+
+extern void
+siWrite(uint32_t offset, uint32_t value);
+
+/* Direct CPU access to PIF RAM, at an offset into it. */
+extern uint32_t
+pifRead32(uint32_t offset);
+
+extern void
+pifWrite32(uint32_t offset, uint32_t value);
+
+/*
+ * Fit a cartridge EEPROM of type, or insert a Controller Pak in port
+ * (0-3), with its contents read from path. Both are raw images, the
+ * .eep and .mpk files other emulators use. A missing file leaves them
+ * blank; any other read error, or a file of the wrong size, fails.
+ */
+extern bool
+pifLoadEEPROM(EEPROMType type, const char *path);
+
+extern bool
+pifLoadPak(int port, const char *path);
+
+/* Write the EEPROM, or the Controller Pak in port, back to path. */
+extern bool
+pifSaveEEPROM(const char *path);
+
+extern bool
+pifSavePak(int port, const char *path);
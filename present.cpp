@@ -0,0 +1,321 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <SDL.h>
+#include <SDL_syswm.h>
+#include <atomic>
+#include <bgfx/bgfx.h>
+#include <bgfx/platform.h>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+#include "debugger.h"
+#include "gui/imgui.h"
+#include "gui/imgui_impl_bgfx.h"
+#include "gui/imgui_impl_sdl.h"
+#include "input.h"
+#include "inspector.h"
+#include "mailbox.h"
+#include "present.h"
+#include "profiler.h"
+#include "timeline.h"
+#include "timers.h"
+#include "vi.h"
+
+using Clock = std::chrono::steady_clock;
+
+static const bgfx::ViewId view = 0;
+static const Clock::duration framePeriod = std::chrono::nanoseconds(
+	1000000000 / 60);
+
+static FrameMailbox mailbox;
+static std::atomic<bool> running;
+static std::atomic<bool> fastForward;
+/* Step back through the rewind history instead of running */
+static std::atomic<bool> rewinding;
+
+struct Windows {
+	bool registers;
+	bool memory;
+	bool disassembly;
+	bool debugger;
+	bool profiler;
+	bool timers;
+};
+
+static void
+emulate(Emulator *e)
+{
+	Clock::time_point next = Clock::now();
+
+	timelineThreadName("emulation");
+	while (running) {
+		e->vi.skipUntaken = fastForward;
+		if (!rewinding) {
+			emulatorFrame(e);
+		} else if (emulatorRewind(e)) {
+			/* Show the frame after the restored one, unrecorded */
+			emulatorRun(e, viFrameCycles);
+		}
+		inspectorPublish(e);
+		debuggerSync(e);
+		/* A stopped instance returns at once; don't spin on it */
+		bool paced = !fastForward || e->debug.stopped || rewinding;
+		timersFrame();
+		if (!paced) {
+			continue;
+		}
+
+		next += framePeriod;
+		Clock::time_point now = Clock::now();
+		if (next < now - 4 * framePeriod) {
+			/* Too far behind (or back from fast-forward) to catch up */
+			next = now;
+		}
+		std::this_thread::sleep_until(next);
+	}
+}
+
+/* The native window for bgfx to render into. */
+static bool
+platformData(SDL_Window *window, bgfx::PlatformData &pd)
+{
+	SDL_SysWMinfo wmi;
+
+	SDL_VERSION(&wmi.version);
+	if (!SDL_GetWindowWMInfo(window, &wmi)) {
+		return false;
+	}
+#if defined(_WIN32)
+	pd.nwh = wmi.info.win.window;
+#elif defined(__APPLE__)
+	pd.nwh = wmi.info.cocoa.window;
+#else
+	pd.ndt = wmi.info.x11.display;
+	pd.nwh = (void *)(uintptr_t)wmi.info.x11.window;
+#endif
+	return true;
+}
+
+/* Scale the frame to fit behind the windows, keeping its aspect. */
+static void
+drawFrame(bgfx::TextureHandle texture, uint32_t width, uint32_t height)
+{
+	if (!width || !height) {
+		return;
+	}
+
+	ImVec2 display = ImGui::GetIO().DisplaySize;
+	float scale = display.x / width < display.y / height
+			      ? display.x / width
+			      : display.y / height;
+	ImVec2 p0((display.x - width * scale) / 2,
+		  (display.y - height * scale) / 2);
+	ImVec2 p1(p0.x + width * scale, p0.y + height * scale);
+	ImVec2 uv((float)width / frameMaxWidth, (float)height / frameMaxHeight);
+
+	ImGui::GetBackgroundDrawList()->AddImage(
+		(ImTextureID)(intptr_t)texture.idx, p0, p1, ImVec2(0, 0), uv);
+}
+
+static void
+menuBar(Windows &w)
+{
+	if (!ImGui::BeginMainMenuBar()) {
+		return;
+	}
+	if (ImGui::BeginMenu("Emulation")) {
+		bool on = fastForward;
+		if (ImGui::MenuItem("Fast-forward", "Tab", &on)) {
+			fastForward = on;
+		}
+		on = rewinding;
+		if (ImGui::MenuItem("Rewind", "Backspace", &on)) {
+			rewinding = on;
+		}
+		ImGui::EndMenu();
+	}
+	if (ImGui::BeginMenu("Debug")) {
+		ImGui::MenuItem("Registers", nullptr, &w.registers);
+		ImGui::MenuItem("Memory", nullptr, &w.memory);
+		ImGui::MenuItem("Disassembly", nullptr, &w.disassembly);
+		ImGui::MenuItem("Debugger", nullptr, &w.debugger);
+		ImGui::MenuItem("Profiler", nullptr, &w.profiler);
+		ImGui::MenuItem("Timers", nullptr, &w.timers);
+		ImGui::EndMenu();
+	}
+	ImGui::EndMainMenuBar();
+}
+
+static void
+drawWindows(Emulator *e, Windows &w)
+{
+	if (w.registers) {
+		registersWindow(e, &w.registers);
+	}
+	if (w.memory) {
+		memoryWindow(e, &w.memory);
+	}
+	if (w.disassembly) {
+		disassemblyWindow(e, &w.disassembly);
+	}
+	if (w.debugger) {
+		debuggerWindow(e, &w.debugger);
+	}
+	if (w.profiler) {
+		profilerWindow(e, &w.profiler);
+	}
+	if (w.timers) {
+		timersWindow(&w.timers);
+	}
+}
+
+int
+presentRun(Emulator *e, bool startFastForward)
+{
+	int width = frameMaxWidth;
+	int height = frameMaxHeight;
+
+	if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS) != 0) {
+		fprintf(stderr, "Could not initialize SDL: %s\n", SDL_GetError());
+		return 1;
+	}
+	SDL_Window *window = SDL_CreateWindow(
+		"n64-emu", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+		width, height, SDL_WINDOW_RESIZABLE);
+	bgfx::PlatformData pd = {};
+	if (!window || !platformData(window, pd)) {
+		fprintf(stderr, "Could not create a window: %s\n",
+			SDL_GetError());
+		SDL_Quit();
+		return 1;
+	}
+
+	/* Render on this thread rather than one bgfx would start */
+	bgfx::renderFrame();
+	bgfx::Init init;
+	init.platformData = pd;
+	init.resolution.width = width;
+	init.resolution.height = height;
+	init.resolution.reset = BGFX_RESET_VSYNC;
+	if (!bgfx::init(init)) {
+		fprintf(stderr, "Could not initialize bgfx\n");
+		SDL_DestroyWindow(window);
+		SDL_Quit();
+		return 1;
+	}
+	bgfx::setViewClear(view, BGFX_CLEAR_COLOR, 0x000000ff);
+	bgfx::setViewRect(view, 0, 0, (uint16_t)width, (uint16_t)height);
+	bgfx::TextureHandle texture = bgfx::createTexture2D(
+		frameMaxWidth, frameMaxHeight, false, 1,
+		bgfx::TextureFormat::RGBA8);
+
+	ImGui::CreateContext();
+	ImGui_Implbgfx_Init(view);
+	ImGui_ImplSDL2_InitForOpenGL(window, nullptr);
+	inputInit();
+	timelineThreadName("presentation");
+
+	e->vi.mailbox = &mailbox;
+	fastForward = startFastForward;
+	rewinding = false;
+	running = true;
+	std::thread worker(emulate, e);
+
+	Windows windows = {};
+	uint32_t frameWidth = 0;
+	uint32_t frameHeight = 0;
+	while (running) {
+		SDL_Event event;
+		while (SDL_PollEvent(&event)) {
+			ImGui_ImplSDL2_ProcessEvent(&event);
+			if (event.type == SDL_QUIT) {
+				running = false;
+			} else if (event.type == SDL_KEYDOWN &&
+				   event.key.keysym.scancode == SDL_SCANCODE_TAB &&
+				   !event.key.repeat &&
+				   !ImGui::GetIO().WantCaptureKeyboard) {
+				fastForward = !fastForward;
+			} else if ((event.type == SDL_KEYDOWN ||
+				    event.type == SDL_KEYUP) &&
+				   event.key.keysym.scancode ==
+					   SDL_SCANCODE_BACKSPACE &&
+				   !ImGui::GetIO().WantCaptureKeyboard) {
+				/* Rewinds for as long as it is held */
+				rewinding = event.type == SDL_KEYDOWN;
+			} else if (event.type == SDL_WINDOWEVENT &&
+				   event.window.event ==
+					   SDL_WINDOWEVENT_SIZE_CHANGED) {
+				width = event.window.data1;
+				height = event.window.data2;
+				bgfx::reset(width, height, BGFX_RESET_VSYNC);
+				bgfx::setViewRect(view, 0, 0, (uint16_t)width,
+						  (uint16_t)height);
+			}
+		}
+
+		if (const Frame *f = mailboxTake(mailbox)) {
+			frameWidth = f->width;
+			frameHeight = f->height;
+			if (frameWidth && frameHeight) {
+				bgfx::updateTexture2D(
+					texture, 0, 0, 0, 0, (uint16_t)frameWidth,
+					(uint16_t)frameHeight,
+					bgfx::copy(f->pixels,
+						   frameWidth * frameHeight * 4));
+			}
+		}
+
+		ImGui_Implbgfx_NewFrame();
+		ImGui_ImplSDL2_NewFrame(window);
+		ImGui::NewFrame();
+		drawFrame(texture, frameWidth, frameHeight);
+		menuBar(windows);
+		drawWindows(e, windows);
+		ImGui::Render();
+
+		bgfx::touch(view);
+		{
+			TIMELINE_WAIT("vsync");
+			bgfx::frame();
+		}
+		inputFramePresented();
+	}
+
+	worker.join();
+	e->vi.mailbox = nullptr;
+
+	inputShutdown();
+	ImGui_ImplSDL2_Shutdown();
+	ImGui_Implbgfx_Shutdown();
+	ImGui::DestroyContext();
+	bgfx::destroy(texture);
+	bgfx::shutdown();
+	SDL_DestroyWindow(window);
+	SDL_Quit();
+	return 0;
+}
@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "gui/imgui.h"
+#include "profiler.h"
+#include "trace.h"
+
+/* Hits keyed by pc << 32 | caller, one table per core */
+typedef std::unordered_map<uint64_t, uint64_t> Histogram;
+
+static std::mutex lock;
+static Histogram hits[TraceCores];
+
+static std::thread timer;
+static std::atomic<bool> running;
+
+/*
+ * The emulation thread writes these without synchronisation. Aligned
+ * 64-bit loads do not tear, and a sample that is an instruction stale
+ * is as good as any other.
+ */
+static inline uint64_t
+peek(const uint64_t &v)
+{
+	return __atomic_load_n(&v, __ATOMIC_RELAXED);
+}
+
+static void
+sample(Emulator *e, unsigned hz)
+{
+	std::chrono::nanoseconds period(1000000000 / hz);
+	auto next = std::chrono::steady_clock::now();
+	uint64_t lastCycles = peek(e->sched.cycles);
+
+	while (running.load(std::memory_order_relaxed)) {
+		next += period;
+		std::this_thread::sleep_until(next);
+
+		uint64_t cycles = peek(e->sched.cycles);
+		if (cycles == lastCycles) {
+			continue;
+		}
+		lastCycles = cycles;
+
+		/* The caller is the JAL before the return address */
+		uint32_t cpuPC = (uint32_t)peek(e->reg.pc);
+		uint32_t cpuCaller = (uint32_t)peek(e->reg.gpr[31]) - 8;
+		uint32_t rspPC = (uint32_t)peek(e->rcp.pc) & 0xfff;
+		uint32_t rspCaller = ((uint32_t)peek(e->rcp.gpr[31]) - 8) & 0xfff;
+
+		std::lock_guard<std::mutex> guard(lock);
+		hits[TraceVR4300][(uint64_t)cpuPC << 32 | cpuCaller]++;
+		hits[TraceRSP][(uint64_t)rspPC << 32 | rspCaller]++;
+	}
+}
+
+void
+profilerStart(Emulator *e, unsigned hz)
+{
+	profilerStop();
+	running = true;
+	timer = std::thread(sample, e, hz);
+}
+
+void
+profilerStop()
+{
+	if (!running) {
+		return;
+	}
+	running = false;
+	timer.join();
+}
+
+bool
+profilerRunning()
+{
+	return running;
+}
+
+void
+profilerReset()
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	for (Histogram &h : hits) {
+		h.clear();
+	}
+}
+
+bool
+profilerExport(const char *path)
+{
+	static const char *const cores[TraceCores] = { "vr4300", "rsp" };
+	FILE *file = fopen(path, "w");
+
+	if (!file) {
+		return false;
+	}
+
+	std::lock_guard<std::mutex> guard(lock);
+	for (int core = 0; core < TraceCores; core++) {
+		for (const auto &hit : hits[core]) {
+			fprintf(file, "%s;0x%08x;0x%08x %llu\n", cores[core],
+				(uint32_t)hit.first, (uint32_t)(hit.first >> 32),
+				(unsigned long long)hit.second);
+		}
+	}
+	return fclose(file) == 0;
+}
+
+struct HotSpot {
+	uint32_t address;
+	uint64_t count;
+	/* The caller that contributed the most samples */
+	uint32_t caller;
+	uint64_t callerCount;
+};
+
+enum SortKey {
+	SortAddress,
+	SortCount,
+};
+
+/* Fold the histogram of one core by address or by block. */
+static std::vector<HotSpot>
+hotSpots(int core, uint32_t blockMask)
+{
+	std::unordered_map<uint32_t, HotSpot> spots;
+
+	std::lock_guard<std::mutex> guard(lock);
+	for (const auto &hit : hits[core]) {
+		uint32_t address = (uint32_t)(hit.first >> 32) & blockMask;
+		HotSpot &s = spots[address];
+		s.address = address;
+		s.count += hit.second;
+		if (hit.second > s.callerCount) {
+			s.caller = (uint32_t)hit.first;
+			s.callerCount = hit.second;
+		}
+	}
+
+	std::vector<HotSpot> rows;
+	rows.reserve(spots.size());
+	for (const auto &s : spots) {
+		rows.push_back(s.second);
+	}
+	return rows;
+}
+
+void
+profilerWindow(Emulator *e, bool *open)
+{
+	static int core = TraceVR4300;
+	static bool blocks;
+	static SortKey sortKey = SortCount;
+	static char exportPath[256] = "profile.folded";
+	static bool exportFailed;
+
+	if (!ImGui::Begin("Profiler", open)) {
+		ImGui::End();
+		return;
+	}
+
+	if (profilerRunning()) {
+		if (ImGui::Button("Stop")) {
+			profilerStop();
+		}
+	} else if (ImGui::Button("Start")) {
+		profilerStart(e);
+	}
+	ImGui::SameLine();
+	if (ImGui::Button("Reset")) {
+		profilerReset();
+	}
+	ImGui::SameLine();
+	ImGui::RadioButton("VR4300", &core, TraceVR4300);
+	ImGui::SameLine();
+	ImGui::RadioButton("RSP", &core, TraceRSP);
+	ImGui::SameLine();
+	ImGui::Checkbox("32-byte blocks", &blocks);
+
+	ImGui::InputText("##path", exportPath, sizeof(exportPath));
+	ImGui::SameLine();
+	if (ImGui::Button("Export folded stacks")) {
+		exportFailed = !profilerExport(exportPath);
+	}
+	if (exportFailed) {
+		ImGui::TextUnformatted("Export failed");
+	}
+
+	std::vector<HotSpot> rows = hotSpots(core, blocks ? ~31u : ~0u);
+	uint64_t samples = 0;
+	for (const HotSpot &s : rows) {
+		samples += s.count;
+	}
+	std::sort(rows.begin(), rows.end(),
+		  [](const HotSpot &a, const HotSpot &b) {
+			  return sortKey == SortCount ? a.count > b.count
+						      : a.address < b.address;
+		  });
+	ImGui::Text("%llu samples", (unsigned long long)samples);
+
+	/* Click a header to sort by it */
+	ImGui::Columns(4, "hotspots");
+	if (ImGui::Selectable("Address", sortKey == SortAddress)) {
+		sortKey = SortAddress;
+	}
+	ImGui::NextColumn();
+	if (ImGui::Selectable("Samples", sortKey == SortCount)) {
+		sortKey = SortCount;
+	}
+	ImGui::NextColumn();
+	ImGui::TextUnformatted("%");
+	ImGui::NextColumn();
+	ImGui::TextUnformatted("Top caller");
+	ImGui::NextColumn();
+	ImGui::Separator();
+
+	ImGuiListClipper clipper;
+	clipper.Begin((int)rows.size());
+	while (clipper.Step()) {
+		for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+			const HotSpot &s = rows[i];
+			ImGui::Text("%08x", s.address);
+			ImGui::NextColumn();
+			ImGui::Text("%llu", (unsigned long long)s.count);
+			ImGui::NextColumn();
+			ImGui::Text("%.2f", 100.0 * s.count / samples);
+			ImGui::NextColumn();
+			ImGui::Text("%08x", s.caller);
+			ImGui::NextColumn();
+		}
+	}
+	ImGui::Columns(1);
+	ImGui::End();
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "emulator.h"
+
+/*
+ * Sampling profiler of guest code. A timer thread reads the program
+ * counters and return addresses of both cores of one instance at a fixed
+ * rate and counts them by address. The emulation thread does no extra
+ * work; samples taken while the instance is paused are dropped.
+ *
+ * The profile can be viewed in an imgui window or exported as folded
+ * stacks ("core;caller;pc count" lines) for flamegraph.pl and similar.
+ */
+
+/* Start sampling e hz times a second, adding to the current profile. */
+extern void
+profilerStart(Emulator *e, unsigned hz = 1000);
+
+/* Stop sampling. Must be called before the instance is destroyed. */
+extern void
+profilerStop();
+
+extern bool
+profilerRunning();
+
+/* Drop all samples. */
+extern void
+profilerReset();
+
+/* Write the profile as folded stacks. Returns false on I/O failure. */
+extern bool
+profilerExport(const char *path);
+
+/* Hot-spot table with start/stop and export controls. */
+extern void
+profilerWindow(Emulator *e, bool *open);
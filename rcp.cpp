@@ -24,560 +24,186 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include <climits>
-#include <cstdlib>
-#include <iostream>
-#include <string>
-
-#include "mem.h"
+#include "bus.h"
+#include "emulator.h"
+#include "mips.h"
+#include "timeline.h"
+#include "timers.h"
 #include "rcp.h"
 
-static int branchRCP = -1;
+/*
+ * The RSP side of the shared core in mips.h. Its scalar unit is a 32-bit
+ * MIPS without 64-bit operations, likely branches, an FPU or exceptions.
+ * Loads and stores go straight to DMEM and instructions come from IMEM;
+ * both wrap at 4 KiB, which also makes unaligned accesses that cross
+ * the end of DMEM wrap byte by byte like the hardware.
+ */
+struct RSP {
+	static const uint64_t pcMask = 0xfff;
+	static const bool mips3 = false;
+	static const bool hasFPU = false;
+	static const bool hasCOP0Ops = false;
+	static const TraceCore traceCore = TraceRSP;
+
+	static ExecState &
+	exec()
+	{
+		return emu->rsp.exec;
+	}
+
+	static Registers &
+	regs()
+	{
+		return *rcp;
+	}
+
+	static uint8_t
+	read8(uint64_t addr)
+	{
+		return sp->dmem[addr & 0xfff];
+	}
+
+	static uint16_t
+	read16(uint64_t addr)
+	{
+		return (uint16_t)(read8(addr) << 8 | read8(addr + 1));
+	}
+
+	static uint32_t
+	read32(uint64_t addr)
+	{
+		return (uint32_t)read16(addr) << 16 | read16(addr + 2);
+	}
+
+	static uint64_t
+	read64(uint64_t addr)
+	{
+		return (uint64_t)read32(addr) << 32 | read32(addr + 4);
+	}
+
+	static void
+	write8(uint64_t addr, uint8_t value)
+	{
+		sp->dmem[addr & 0xfff] = value;
+	}
+
+	static void
+	write16(uint64_t addr, uint16_t value)
+	{
+		write8(addr, (uint8_t)(value >> 8));
+		write8(addr + 1, (uint8_t)value);
+	}
+
+	static void
+	write32(uint64_t addr, uint32_t value)
+	{
+		write16(addr, (uint16_t)(value >> 16));
+		write16(addr + 2, (uint16_t)value);
+	}
+
+	static void
+	write64(uint64_t addr, uint64_t value)
+	{
+		write32(addr, (uint32_t)(value >> 32));
+		write32(addr + 4, (uint32_t)value);
+	}
+
+	/* COP0 registers 0-7 are the SP registers, 8-15 the DP ones. */
+	static uint32_t
+	cop0Address(int rd)
+	{
+		return (rd & 8 ? 0x04100000 : 0x04040000) + 4 * (rd & 7);
+	}
+
+	static uint64_t
+	readCOP0(int rd)
+	{
+		return mmioRead32(cop0Address(rd));
+	}
+
+	static void
+	writeCOP0(int rd, uint64_t value)
+	{
+		mmioWrite32(cop0Address(rd), (uint32_t)value);
+	}
+
+	static void
+	exception(ExceptionCode)
+	{
+	}
+
+	static void
+	eret()
+	{
+	}
+
+	template <class P>
+	static const Decoded &
+	fetch(uint64_t pc);
+};
+
+template <class P>
+const Decoded &
+RSP::fetch(uint64_t pc)
+{
+	uint32_t addr = pc & 0xffc;
+	uint32_t opcode = (uint32_t)sp->imem[addr] << 24 |
+			  (uint32_t)sp->imem[addr + 1] << 16 |
+			  (uint32_t)sp->imem[addr + 2] << 8 | sp->imem[addr + 3];
+
+	/*
+	 * IMEM is tiny and written by DMA and the CPU alike, so rather than
+	 * tracking writes each fetch compares the opcode it decoded with
+	 * what is there now.
+	 */
+	Decoded &d = emu->rsp.decoded[addr >> 2];
+	if (!d.handler || d.opcode != opcode) {
+		d = decode<RSP, P>(opcode);
+	}
+	return d;
+}
 
 void
-execRCP(uint32_t opcode, bool parseOnly)
+rspReset()
 {
-	uint8_t op = (opcode & 0b11111100000000000000000000000000) >> 26;
-	/* I-Type (Immediate) variables */
-	uint16_t immediate = opcode & 0b00000000000000001111111111111111;
-	/* J-Type (Jump) variables */
-	uint32_t target = opcode & 0b00000011111111111111111111111111;
-	/* R-Type (Register) variables (rs, rt used in I Type as well) */
-	uint8_t rs = opcode & 0b00000011111000000000000000000000 >> 21;
-	uint8_t rt = opcode & 0b00000000000111110000000000000000 >> 16;
-	uint8_t rd = opcode & 0b00000000000000001111100000000000 >> 11;
-	uint8_t sa = opcode & 0b00000000000000000000011111000000 >> 6;
-	uint8_t funct = opcode & 0b00000000000000000000000000111111;
-	if (!parseOnly) {
-		switch (op) {
-		case 0b00000000:
-			if (sa == 0b00000000) {
-				switch (funct) {
-				case 0b00100000: /* ADD */
-					if (rcp.gpr[rs] <
-					    INT_MAX - rcp.gpr[rt]) {
-						/* Add integer overflow code! */
-					}
-					rcp.gpr[rd] = ((signed)rcp.gpr[rs] +
-						       (signed)rcp.gpr[rt]);
-					break;
-				case 0b00100001: /* ADDU */
-					rcp.gpr[rd] =
-						(rcp.gpr[rs] + rcp.gpr[rt]);
-					break;
-				case 0b00100100: /* AND */
-					rcp.gpr[rd] =
-						(rcp.gpr[rs] & rcp.gpr[rt]);
-					break;
-				case 0b00101100: /* DADD */
-					/*
-					 * Note: Should only run in 64
-					 * bit mode or 32 bit kernel
-					 * mode. Otherwise throw
-					 * reserved instruction
-					 * exception.
-					 */
-					if (rcp.gpr[rs] <
-					    INT_MAX - rcp.gpr[rt]) {
-						/* Add integer overflow code! */
-					}
-					rcp.gpr[rd] = ((signed)rcp.gpr[rs] +
-						       (signed)rcp.gpr[rt]);
-				}
-			} else {
-				switch (funct) {
-				case 0b00001101: /* BREAK */
-					/* TODO */
-					break;
-				}
-			}
-			break;
-		case 0b00001000: /* ADDI */
-			if (rcp.gpr[rs] <
-			    INT_MAX - rcp.gpr[signExtend(immediate)]) {
-				/* Add integer overflow code! */
-			}
-			rcp.gpr[rt] = ((signed)rcp.gpr[rs] +
-				       (signed)signExtend(immediate));
-			break;
-		case 0b00001001: /* ADDIU */
-			rcp.gpr[rt] = (rcp.gpr[rs] + signExtend(immediate));
-			break;
-		case 0b00001100: /* ANDI */
-			rcp.gpr[rt] = (rcp.gpr[rs] & immediate);
-			break;
-		case 0b00010000:
-			if ((sa == 0) && (funct == 0)) {
-				switch (rs) {
-				case 0b00000010: /* CFC0 */
-					/* TODO */
-					break;
-				}
-			} else {
-				switch (rs) {
-				case 0b00001000:
-					switch (rt) {
-					case 0b00000000: /* BC0F */
-						/* TODO */
-						break;
-					case 0b00000010: /* BC0FL */
-						/* TODO */
-						break;
-					case 0b00000001: /* BC0T */
-						/* TODO */
-						break;
-					case 0b00000011: /* BC0TL */
-						/* TODO */
-						break;
-					}
-					break;
-				case 0b00010000: /* COP0 */
-					/* TODO */
-					break;
-				case 0b0000110:
-					if (opcode &
-					    0b00000000000000000000011111111111) { /* CTC0 */
-						/* TODO */
-					}
-					break;
-				}
-			}
-			break;
-		case 0b00010001:
-			if ((sa == 0) && (funct == 0)) {
-				switch (rs) {
-				case 0b00000010: /* CFC1 */
-					/* TODO */
-					break;
-				}
-			} else {
-				switch (rs) {
-				case 0b00001000:
-					switch (rt) {
-					case 0b00000000: /* BC1F */
-						/* TODO */
-						break;
-					case 0b00000010: /* BC1FL */
-						/* TODO */
-						break;
-					case 0b00000001: /* BC1T */
-						/* TODO */
-						break;
-					case 0b00000011: /* BC1TL */
-						/* TODO */
-						break;
-					}
-					break;
-				case 0b00010000: /* COP1 */
-					/* TODO */
-					break;
-				case 0b0000110:
-					if (opcode &
-					    0b00000000000000000000011111111111) { /* CTC1 */
-						/* TODO */
-					}
-					break;
-				}
-			}
-			break;
-		case 0b00010010:
-			if ((sa == 0) && (funct == 0)) {
-				switch (rs) {
-				case 0b00000010: /* CFC2 */
-					/* TODO */
-					break;
-				}
-			} else {
-				switch (rs) {
-				case 0b00001000:
-					switch (rt) {
-					case 0b00000000: /* BC2F */
-						/* TODO */
-						break;
-					case 0b00000010: /* BC2FL */
-						/* TODO */
-						break;
-					case 0b00000001: /* BC2T */
-						/* TODO */
-						break;
-					case 0b00000011: /* BC2TL */
-						/* TODO */
-						break;
-					}
-					break;
-				case 0b00010000: /* COP2 */
-					/* TODO */
-					break;
-				case 0b0000110:
-					if (opcode &
-					    0b00000000000000000000011111111111) { /* CTC2 */
-						/* TODO */
-					}
-					break;
-				}
-			}
-			break;
-		case 0b00010011:
-			if ((sa == 0) && (funct == 0)) {
-				switch (rs) {
-				case 0b00000010: /* CFC3 */
-					/* TODO */
-					break;
-				}
-			} else {
-				switch (rs) {
-				case 0b00001000:
-					switch (rt) {
-					case 0b00000000: /* BC3F */
-						/* TODO */
-						break;
-					case 0b00000010: /* BC3FL */
-						/* TODO */
-						break;
-					case 0b00000001: /* BC3T */
-						/* TODO */
-						break;
-					case 0b00000011: /* BC3TL */
-						/* TODO */
-						break;
-					}
-					break;
-				case 0b00010000: /* COP3 */
-					/* TODO */
-					break;
-				case 0b0000110:
-					if (opcode &
-					    0b00000000000000000000011111111111) { /* CTC3 */
-						/* TODO */
-					}
-					break;
-				}
-			}
-			break;
-		case 0b00000100: /* BEQ */
-			if (rcp.gpr[rs] == rcp.gpr[rt]) {
-				branchRCP = mem.mem[rcp.pc + 1] +
-					    (signExtend(immediate) << 2);
-			}
-			break;
-		case 0b00010100: /* BEQL */
-			if (rcp.gpr[rs] == rcp.gpr[rt]) {
-				branchRCP = mem.mem[rcp.pc + 1] +
-					    (signExtend(immediate) << 2);
-			} else {
-				rcp.pc++;
-			}
-			break;
-		case 0b00000001:
-			switch (rt) {
-			case 0b00000001: /* BGEZ */
-				if (rcp.gpr[rs] >= 0) {
-					branchRCP =
-						mem.mem[rcp.pc + 1] +
-						(signExtend(immediate) << 2);
-				}
-				break;
-			case 0b00010001: /* BGEZAL */
-				rcp.gpr[31] = mem.mem[rcp.pc + 1];
-				if (rcp.gpr[rs] >= 0) {
-					branchRCP =
-						mem.mem[rcp.pc + 1] +
-						(signExtend(immediate) << 2);
-				}
-				break;
-			case 0b00010011: /* BGEZALL */
-				rcp.gpr[31] = mem.mem[rcp.pc + 1];
-				if (rcp.gpr[rs] >= 0) {
-					branchRCP =
-						mem.mem[rcp.pc + 1] +
-						(signExtend(immediate) << 2);
-				} else {
-					rcp.pc++;
-				}
-				break;
-			case 0b00000011: /* BGEZL */
-				if (rcp.gpr[rs] >= 0) {
-					branchRCP =
-						mem.mem[rcp.pc + 1] +
-						(signExtend(immediate) << 2);
-				} else {
-					rcp.pc++;
-				}
-				break;
-			case 0b00000000: /* BLTZ */
-				if (rcp.gpr[rs] < 0) {
-					branchRCP =
-						mem.mem[rcp.pc + 1] +
-						(signExtend(immediate) << 2);
-				}
-				break;
-			case 0b00010000: /* BLTZAL */
-				rcp.gpr[31] = mem.mem[rcp.pc + 1];
-				if (rcp.gpr[rs] < 0) {
-					branchRCP =
-						mem.mem[rcp.pc + 1] +
-						(signExtend(immediate) << 2);
-				}
-				break;
-			case 0b00010010: /* BLTZALL */
-				rcp.gpr[31] = mem.mem[rcp.pc + 1];
-				if (rcp.gpr[rs] < 0) {
-					branchRCP =
-						mem.mem[rcp.pc + 1] +
-						(signExtend(immediate) << 2);
-				} else {
-					rcp.pc++;
-				}
-				break;
-			case 0b00000010: /* BLTZL */
-				if (rcp.gpr[rs] < 0) {
-					branchRCP =
-						mem.mem[rcp.pc + 1] +
-						(signExtend(immediate) << 2);
-				} else {
-					rcp.pc++;
-				}
-				break;
-			}
-			break;
-		case 0b00000111:
-			switch (rt) {
-			case 0b00000000: /* BGTZ */
-				if (rcp.gpr[rs] > 0) {
-					branchRCP =
-						mem.mem[rcp.pc + 1] +
-						(signExtend(immediate) << 2);
-				}
-				break;
-			}
-			break;
-		case 0b00010111:
-			switch (rt) {
-			case 0b00000000: /* BGTZL */
-				if (rcp.gpr[rs] > 0) {
-					branchRCP =
-						mem.mem[rcp.pc + 1] +
-						(signExtend(immediate) << 2);
-				} else {
-					rcp.pc++;
-				}
-				break;
-			}
-			break;
-		case 0b00000110:
-			switch (rt) {
-			case 0b00000000: /* BLEZ */
-				if (rcp.gpr[rs] <= 0) {
-					branchRCP =
-						mem.mem[rcp.pc + 1] +
-						(signExtend(immediate) << 2);
-				}
-				break;
-			}
-			break;
-		case 0b00010110:
-			switch (rt) {
-			case 0b00000000: /* BLEZL */
-				if (rcp.gpr[rs] <= 0) {
-					branchRCP =
-						mem.mem[rcp.pc + 1] +
-						(signExtend(immediate) << 2);
-				} else {
-					rcp.pc++;
-				}
-				break;
-			}
-			break;
-		case 0b00000101: /* BNE */
-			if (rcp.gpr[rs] != rcp.gpr[rt]) {
-				branchRCP = mem.mem[rcp.pc + 1] +
-					    (signExtend(immediate) << 2);
-			}
-			break;
-		case 0b00010101: /* BNEL */
-			if (rcp.gpr[rs] != rcp.gpr[rt]) {
-				branchRCP = mem.mem[rcp.pc + 1] +
-					    (signExtend(immediate) << 2);
-			} else {
-				rcp.pc++;
-			}
-			break;
-		case 0b00101111: /* CACHE */
-			/* TODO */
-			break;
-		default:
-			/* Add unknown opcode! */
-			break;
-			if (branchRCP >= 0) {
-				rcp.pc = branchRCP;
-				branchRCP = -1;
-			}
-		}
-	} else {
-		switch (op) {
-		case 0b00000000: /* ADD */
-			std::cout << "ADD";
-			break;
-		case 0b00001000: /* ADDI */
-			std::cout << "ADDI";
-			break;
-		case 0b00001001: /* ADDIU */
-			std::cout << "ADDIU";
-			break;
-		case 0b00101111: /* CACHE */
-			/* TODO */
-			break;
-		case 0b00010000:
-			if ((sa == 0) && (funct == 0)) {
-				switch (rs) {
-				case 0b00000010: /* CFC0 */
-					/* TODO */
-					break;
-				}
-			} else {
-				switch (rs) {
-				case 0b00001000:
-					switch (rt) {
-					case 0b00000000: /* BC0F */
-						/* TODO */
-						break;
-					case 0b00000010: /* BC0FL */
-						/* TODO */
-						break;
-					case 0b00000001: /* BC0T */
-						/* TODO */
-						break;
-					case 0b00000011: /* BC0TL */
-						/* TODO */
-						break;
-					}
-					break;
-				case 0b00010000: /* COP0 */
-					/* TODO */
-					break;
-				case 0b0000110:
-					if (opcode &
-					    0b00000000000000000000011111111111) { /* CTC0 */
-						/* TODO */
-					}
-					break;
-				}
-			}
-			break;
-		case 0b00010001:
-			if ((sa == 0) && (funct == 0)) {
-				switch (rs) {
-				case 0b00000010: /* CFC1 */
-					/* TODO */
-					break;
-				}
-			} else {
-				switch (rs) {
-				case 0b00001000:
-					switch (rt) {
-					case 0b00000000: /* BC1F */
-						/* TODO */
-						break;
-					case 0b00000010: /* BC1FL */
-						/* TODO */
-						break;
-					case 0b00000001: /* BC1T */
-						/* TODO */
-						break;
-					case 0b00000011: /* BC1TL */
-						/* TODO */
-						break;
-					}
-					break;
-				case 0b00010000: /* COP1 */
-					/* TODO */
-					break;
-				case 0b0000110:
-					if (opcode &
-					    0b00000000000000000000011111111111) { /* CTC1 */
-						/* TODO */
-					}
-					break;
-				}
-			}
-			break;
-		case 0b00010010:
-			if ((sa == 0) && (funct == 0)) {
-				switch (rs) {
-				case 0b00000010: /* CFC2 */
-					/* TODO */
-					break;
-				}
-			} else {
-				switch (rs) {
-				case 0b00001000:
-					switch (rt) {
-					case 0b00000000: /* BC2F */
-						/* TODO */
-						break;
-					case 0b00000010: /* BC2FL */
-						/* TODO */
-						break;
-					case 0b00000001: /* BC2T */
-						/* TODO */
-						break;
-					case 0b00000011: /* BC2TL */
-						/* TODO */
-						break;
-					}
-					break;
-				case 0b00010000: /* COP2 */
-					/* TODO */
-					break;
-				case 0b0000110:
-					if (opcode &
-					    0b00000000000000000000011111111111) { /* CTC2 */
-						/* TODO */
-					}
-					break;
-				}
-			}
-			break;
-		case 0b00010011:
-			if ((sa == 0) && (funct == 0)) {
-				switch (rs) {
-				case 0b00000010: /* CFC3 */
-					/* TODO */
-					break;
-				}
-			} else {
-				switch (rs) {
-				case 0b00001000:
-					switch (rt) {
-					case 0b00000000: /* BC3F */
-						/* TODO */
-						break;
-					case 0b00000010: /* BC3FL */
-						/* TODO */
-						break;
-					case 0b00000001: /* BC3T */
-						/* TODO */
-						break;
-					case 0b00000011: /* BC3TL */
-						/* TODO */
-						break;
-					}
-					break;
-				case 0b00010000: /* COP3 */
-					/* TODO */
-					break;
-				case 0b0000110:
-					if (opcode &
-					    0b00000000000000000000011111111111) { /* CTC3 */
-						/* TODO */
-					}
-					break;
-				}
-			}
-			break;
-		default:
-			/* Add unknown opcode! */
-			break;
+	rcp->pc = 0;
+	rcp->nextPC = 4;
+	rcp->delaySlot = false;
+}
+
+template <class P>
+static void
+run(uint64_t instructions)
+{
+	for (uint64_t i = 0; i < instructions; i++) {
+		step<RSP, P>();
+	}
+}
+
+void
+rspConfigure(const CPUOptions &options)
+{
+	/* The RSP has no 64-bit mode, overflow traps or RDRAM to watch */
+	static void (*const runners[2])(uint64_t) = {
+		run<Policy<false, false, false, false>>,
+		run<Policy<false, false, true, false>>,
+	};
+
+	RSPState &s = emu->rsp;
+	if (s.run != runners[options.trace]) {
+		s.run = runners[options.trace];
+		/* Cached handlers belong to the old policy */
+		for (Decoded &d : s.decoded) {
+			d.handler = nullptr;
 		}
 	}
 }
+
+void
+runRSP(uint64_t instructions)
+{
+	TIMER_SCOPE(TimerRSP);
+	TIMELINE_SPAN("rsp");
+
+	emu->rsp.run(instructions);
+}
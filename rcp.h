@@ -30,7 +30,26 @@
 
 #include "cpu.h"
 
-extern Registers rcp;
+/* RSP local memory, 4 KiB each of data and instruction RAM. */
+struct SPMemory {
+	uint8_t dmem[4096];
+	uint8_t imem[4096];
+};
 
+extern thread_local Registers *rcp;
+extern thread_local SPMemory *sp;
+
+/* Start the RSP at the beginning of IMEM. */
+extern void
+rspReset();
+
+/*
+ * Pick the RSP interpreter variant for options. Only tracing applies to
+ * the RSP; cpuConfigure() calls this.
+ */
+extern void
+rspConfigure(const CPUOptions &options);
+
+/* Run the RSP scalar unit for a number of instructions. */
 extern void
-execRCP(uint32_t opcode, bool parseOnly);
+runRSP(uint64_t instructions);
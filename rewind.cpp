@@ -0,0 +1,283 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstring>
+
+#include "lz.h"
+#include "mem.h"
+#include "rewind.h"
+#include "savestate.h"
+
+/*
+ * A delta entry is laid out as:
+ *   u32 state size, register-only save state,
+ *   u32 page count, u16 page numbers,
+ *   u32 packed size, LZ compressed page contents.
+ */
+
+static size_t
+deltaBound()
+{
+	return 4 + saveStateBound(false) + 4 + 2 * rdramPages + 4 +
+	       lzBound(rdramSize);
+}
+
+static inline size_t
+slot(const RewindBuffer &rb, size_t i)
+{
+	return (rb.first + i) % rb.entries.size();
+}
+
+static inline void
+put32(uint8_t *&p, uint32_t v)
+{
+	memcpy(p, &v, sizeof(v));
+	p += sizeof(v);
+}
+
+static inline uint32_t
+get32(const uint8_t *&p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	p += sizeof(v);
+	return v;
+}
+
+void
+rewindInit(RewindBuffer &rb, size_t bytes, size_t maxEntries,
+	   int keyframeInterval)
+{
+	rb.data.resize(bytes);
+	rb.entries.resize(maxEntries);
+	rb.keyframeInterval = keyframeInterval;
+	size_t full = saveStateBound();
+	rb.scratch.resize(full > deltaBound() ? full : deltaBound());
+	rb.pageData.resize(rdramSize);
+	rb.pages.resize(rdramPages);
+	rewindClear(rb);
+}
+
+void
+rewindClear(RewindBuffer &rb)
+{
+	rb.first = 0;
+	rb.count = 0;
+	rb.sinceKeyframe = rb.keyframeInterval;
+}
+
+/* Drop the oldest keyframe and the deltas that depend on it. */
+static void
+dropOldest(RewindBuffer &rb)
+{
+	do {
+		rb.first = slot(rb, 1);
+		rb.count--;
+	} while (rb.count && !rb.entries[rb.first].keyframe);
+}
+
+/* Find room for size bytes, evicting old history as needed. */
+static bool
+reserve(RewindBuffer &rb, size_t size, size_t &offset)
+{
+	if (size > rb.data.size() || rb.entries.empty()) {
+		return false;
+	}
+
+	for (;;) {
+		if (rb.count == 0) {
+			offset = 0;
+			return true;
+		}
+		if (rb.count < rb.entries.size()) {
+			const RewindEntry &oldest = rb.entries[rb.first];
+			const RewindEntry &newest =
+				rb.entries[slot(rb, rb.count - 1)];
+			size_t head = newest.offset + newest.size;
+			size_t tail = oldest.offset;
+
+			if (newest.offset >= oldest.offset) {
+				if (rb.data.size() - head >= size) {
+					offset = head;
+					return true;
+				}
+				if (tail >= size) {
+					offset = 0;
+					return true;
+				}
+			} else if (tail - head >= size) {
+				offset = head;
+				return true;
+			}
+		}
+		dropOldest(rb);
+	}
+}
+
+static size_t
+packDelta(RewindBuffer &rb)
+{
+	uint8_t *start = rb.scratch.data();
+	uint8_t *end = start + rb.scratch.size();
+	uint8_t *p = start + 4;
+
+	size_t stateSize = saveState(p, end - p, false);
+	if (!stateSize) {
+		return 0;
+	}
+	p = start;
+	put32(p, (uint32_t)stateSize);
+	p += stateSize;
+
+	uint32_t count = collectDirty(DirtyRewind, rb.pages.data());
+	put32(p, count);
+	memcpy(p, rb.pages.data(), count * sizeof(uint16_t));
+	p += count * sizeof(uint16_t);
+
+	for (uint32_t i = 0; i < count; i++) {
+		memcpy(&rb.pageData[i * rdramPageSize],
+		       &mem->mem[rb.pages[i] * rdramPageSize], rdramPageSize);
+	}
+	size_t packed = lzCompress(rb.pageData.data(), count * rdramPageSize,
+				   p + 4, end - (p + 4));
+	if (!packed) {
+		return 0;
+	}
+	put32(p, (uint32_t)packed);
+	p += packed;
+
+	return p - start;
+}
+
+static bool
+applyDelta(RewindBuffer &rb, const uint8_t *p)
+{
+	uint32_t stateSize = get32(p);
+	if (!loadState(p, stateSize)) {
+		return false;
+	}
+	p += stateSize;
+
+	uint32_t count = get32(p);
+	const uint8_t *pages = p;
+	p += count * sizeof(uint16_t);
+
+	uint32_t packed = get32(p);
+	if (!lzDecompress(p, packed, rb.pageData.data(),
+			  count * rdramPageSize)) {
+		return false;
+	}
+	for (uint32_t i = 0; i < count; i++) {
+		uint16_t page;
+		memcpy(&page, pages + i * sizeof(page), sizeof(page));
+		memcpy(&mem->mem[page * rdramPageSize],
+		       &rb.pageData[i * rdramPageSize], rdramPageSize);
+		mem->dirty[page] = 0xff;
+	}
+	return true;
+}
+
+bool
+rewindPush(RewindBuffer &rb)
+{
+	bool keyframe = rb.count == 0 || rb.sinceKeyframe >= rb.keyframeInterval;
+	size_t size;
+
+	if (keyframe) {
+		clearDirty(DirtyRewind);
+		size = saveState(rb.scratch.data(), rb.scratch.size());
+	} else {
+		size = packDelta(rb);
+	}
+	size_t offset;
+	if (!size || !reserve(rb, size, offset)) {
+		/*
+		 * The dirty bits were already consumed, so a delta against
+		 * this point would miss pages; start over from a keyframe.
+		 */
+		rb.sinceKeyframe = rb.keyframeInterval;
+		return false;
+	}
+	if (!keyframe && rb.count == 0) {
+		/* Making room evicted this delta's base; store a keyframe. */
+		rb.sinceKeyframe = rb.keyframeInterval;
+		return rewindPush(rb);
+	}
+
+	memcpy(&rb.data[offset], rb.scratch.data(), size);
+	rb.entries[slot(rb, rb.count)] = { offset, size, keyframe };
+	rb.count++;
+	rb.sinceKeyframe = keyframe ? 1 : rb.sinceKeyframe + 1;
+	return true;
+}
+
+bool
+rewindPop(RewindBuffer &rb)
+{
+	if (rb.count == 0) {
+		return false;
+	}
+
+	size_t newest = rb.count - 1;
+	size_t base = newest;
+	while (!rb.entries[slot(rb, base)].keyframe) {
+		base--;
+	}
+
+	const RewindEntry &key = rb.entries[slot(rb, base)];
+	if (!loadState(&rb.data[key.offset], key.size)) {
+		return false;
+	}
+	for (size_t i = base + 1; i <= newest; i++) {
+		if (!applyDelta(rb, &rb.data[rb.entries[slot(rb, i)].offset])) {
+			return false;
+		}
+	}
+	clearDirty(DirtyRewind);
+
+	/*
+	 * The next delta is relative to the snapshot before this one, so the
+	 * pages this one changed count as dirty again. If this was a
+	 * keyframe that difference is unknown and the next push must be a
+	 * keyframe too.
+	 */
+	const RewindEntry &top = rb.entries[slot(rb, newest)];
+	if (top.keyframe) {
+		rb.sinceKeyframe = rb.keyframeInterval;
+	} else {
+		const uint8_t *p = &rb.data[top.offset];
+		p += get32(p);
+		uint32_t count = get32(p);
+		for (uint32_t i = 0; i < count; i++) {
+			uint16_t page;
+			memcpy(&page, p + i * sizeof(page), sizeof(page));
+			mem->dirty[page] |= DirtyRewind;
+		}
+		rb.sinceKeyframe--;
+	}
+	rb.count--;
+	return true;
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Rewind history, kept as a ring of snapshots in a fixed-size buffer.
+ *
+ * Every keyframeInterval-th snapshot is a keyframe (a full save state);
+ * the rest are deltas holding the register state plus the RDRAM pages
+ * dirtied since the previous snapshot, LZ compressed. Restoring a delta
+ * loads its keyframe and replays the deltas after it. When the buffer
+ * fills, the oldest keyframe is dropped together with its deltas.
+ *
+ * All memory is allocated by rewindInit(); pushing and popping never
+ * allocate.
+ */
+
+struct RewindEntry {
+	size_t offset;
+	size_t size;
+	bool keyframe;
+};
+
+struct RewindBuffer {
+	std::vector<uint8_t> data;
+	std::vector<RewindEntry> entries;
+	size_t first = 0;
+	size_t count = 0;
+	int keyframeInterval = 0;
+	int sinceKeyframe = 0;
+	/* Staging for one compressed entry, and page gathering. */
+	std::vector<uint8_t> scratch;
+	std::vector<uint8_t> pageData;
+	std::vector<uint16_t> pages;
+};
+
+/*
+ * Size the history to hold bytes of snapshot data and at most
+ * maxEntries snapshots.
+ */
+extern void
+rewindInit(RewindBuffer &rb, size_t bytes, size_t maxEntries,
+	   int keyframeInterval);
+
+/* Record the current machine state. Returns false if it cannot fit. */
+extern bool
+rewindPush(RewindBuffer &rb);
+
+/*
+ * Restore the most recent snapshot and drop it from the history.
+ * Returns false if the history is empty.
+ */
+extern bool
+rewindPop(RewindBuffer &rb);
+
+/* Forget all history; the next push is a keyframe. */
+extern void
+rewindClear(RewindBuffer &rb);
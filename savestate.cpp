@@ -0,0 +1,495 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstring>
+
+#include "byteswap.h"
+#include "cpu.h"
+#include "emulator.h"
+#include "fpu.h"
+#include "lz.h"
+#include "mem.h"
+#include "mi.h"
+#include "pif.h"
+#include "rcp.h"
+#include "scheduler.h"
+#include "savestate.h"
+#include "vi.h"
+
+static constexpr uint32_t
+fourCC(const char (&s)[5])
+{
+	return (uint32_t)s[0] | (uint32_t)s[1] << 8 | (uint32_t)s[2] << 16 |
+	       (uint32_t)s[3] << 24;
+}
+
+static const uint32_t tagCPU = fourCC("CPU ");
+static const uint32_t tagRSP = fourCC("RSP ");
+static const uint32_t tagSP = fourCC("SPMM");
+static const uint32_t tagMI = fourCC("MI  ");
+static const uint32_t tagVI = fourCC("VI  ");
+static const uint32_t tagPIF = fourCC("PIF ");
+static const uint32_t tagScheduler = fourCC("SCHD");
+static const uint32_t tagRDRAM = fourCC("RDRM");
+
+static const size_t headerSize = 8;
+static const size_t sectionHeaderSize = 8;
+static const size_t registersSize =
+	8 * 4 + 1 + 8 * 32 + 1 + 8 * 32 + 4 + 8 * 32;
+static const size_t miSize = 3 * 4;
+/* Registers, last sync and frame count. */
+static const size_t viSize = 4 * VIRegisters + 8 + 8;
+static const size_t schedulerSize = 8 + 8 * EventTypes;
+/* RAM, SI registers, EEPROM type and mask of inserted paks. */
+static const size_t pifFixedSize = sizeof(PIF::ram) + 4 + 4 + 1 + 1;
+/* Flags, uncompressed size, compressed size. */
+static const size_t rdramHeaderSize = 12;
+
+struct Writer {
+	uint8_t *p;
+	uint8_t *end;
+	bool ok;
+};
+
+static inline void
+putBytes(Writer &w, const void *data, size_t size)
+{
+	if ((size_t)(w.end - w.p) < size) {
+		w.ok = false;
+		return;
+	}
+	memcpy(w.p, data, size);
+	w.p += size;
+}
+
+static inline void
+put8(Writer &w, uint8_t v)
+{
+	putBytes(w, &v, sizeof(v));
+}
+
+static inline void
+put32(Writer &w, uint32_t v)
+{
+	putBytes(w, &v, sizeof(v));
+}
+
+static inline void
+put64(Writer &w, uint64_t v)
+{
+	putBytes(w, &v, sizeof(v));
+}
+
+/* Returns the offset of the length field, patched by endSection(). */
+static uint8_t *
+beginSection(Writer &w, uint32_t tag)
+{
+	put32(w, tag);
+	uint8_t *len = w.p;
+	put32(w, 0);
+	return len;
+}
+
+static void
+endSection(Writer &w, uint8_t *len)
+{
+	if (!w.ok) {
+		return;
+	}
+	uint32_t size = (uint32_t)(w.p - (len + 4));
+	memcpy(len, &size, sizeof(size));
+}
+
+static void
+putRegisters(Writer &w, const Registers &r)
+{
+	put64(w, r.pc);
+	put64(w, r.nextPC);
+	put8(w, r.delaySlot);
+	put64(w, r.hi);
+	put64(w, r.lo);
+	for (int i = 0; i < 32; i++) {
+		put64(w, r.gpr[i]);
+	}
+	put8(w, r.llbit);
+	for (int i = 0; i < 32; i++) {
+		put64(w, r.fpr[i]);
+	}
+	put32(w, r.fcr31);
+	for (int i = 0; i < 32; i++) {
+		put64(w, r.cop0[i]);
+	}
+}
+
+/* A u32 compressed size followed by the LZ compressed data. */
+static void
+putPacked(Writer &w, const uint8_t *data, size_t size)
+{
+	uint8_t *packedSize = w.p;
+	put32(w, 0);
+	if (!w.ok) {
+		return;
+	}
+	size_t packed = lzCompress(data, size, w.p, w.end - w.p);
+	if (!packed) {
+		w.ok = false;
+		return;
+	}
+	uint32_t packed32 = (uint32_t)packed;
+	memcpy(packedSize, &packed32, sizeof(packed32));
+	w.p += packed;
+}
+
+struct Reader {
+	const uint8_t *p;
+	const uint8_t *end;
+};
+
+static inline void
+getBytes(Reader &r, void *data, size_t size)
+{
+	/* Sizes are validated up front, so no bounds checks here. */
+	memcpy(data, r.p, size);
+	r.p += size;
+}
+
+static inline uint8_t
+get8(Reader &r)
+{
+	uint8_t v;
+	getBytes(r, &v, sizeof(v));
+	return v;
+}
+
+static inline uint32_t
+get32(Reader &r)
+{
+	uint32_t v;
+	getBytes(r, &v, sizeof(v));
+	return v;
+}
+
+static inline uint64_t
+get64(Reader &r)
+{
+	uint64_t v;
+	getBytes(r, &v, sizeof(v));
+	return v;
+}
+
+static void
+getRegisters(Reader &rd, Registers &r)
+{
+	r.pc = get64(rd);
+	r.nextPC = get64(rd);
+	r.delaySlot = get8(rd) != 0;
+	r.hi = get64(rd);
+	r.lo = get64(rd);
+	for (int i = 0; i < 32; i++) {
+		r.gpr[i] = get64(rd);
+	}
+	r.llbit = get8(rd) != 0;
+	for (int i = 0; i < 32; i++) {
+		r.fpr[i] = get64(rd);
+	}
+	r.fcr31 = get32(rd);
+	for (int i = 0; i < 32; i++) {
+		r.cop0[i] = get64(rd);
+	}
+}
+
+size_t
+saveStateBound(bool withRDRAM)
+{
+	size_t size = headerSize + 7 * sectionHeaderSize + 2 * registersSize +
+		      sizeof(*sp) + miSize + viSize + schedulerSize +
+		      pifFixedSize +
+		      sizeof(pif->eeprom) +
+		      4 * (4 + lzBound(sizeof(pif->pak[0])));
+	if (withRDRAM) {
+		size += sectionHeaderSize + rdramHeaderSize +
+			lzBound(rdramSize);
+	}
+	return size;
+}
+
+size_t
+saveState(uint8_t *buf, size_t capacity, bool withRDRAM)
+{
+	Writer w = { buf, buf + capacity, true };
+	uint8_t *len;
+
+	put32(w, saveStateMagic);
+	put32(w, saveStateVersion);
+
+	len = beginSection(w, tagCPU);
+	putRegisters(w, *reg);
+	endSection(w, len);
+
+	len = beginSection(w, tagRSP);
+	putRegisters(w, *rcp);
+	endSection(w, len);
+
+	len = beginSection(w, tagSP);
+	putBytes(w, sp->dmem, sizeof(sp->dmem));
+	putBytes(w, sp->imem, sizeof(sp->imem));
+	endSection(w, len);
+
+	len = beginSection(w, tagMI);
+	put32(w, mi->mode);
+	put32(w, mi->intr);
+	put32(w, mi->mask);
+	endSection(w, len);
+
+	len = beginSection(w, tagVI);
+	for (uint32_t r : emu->vi.regs) {
+		put32(w, r);
+	}
+	put64(w, emu->vi.lastSync);
+	put64(w, emu->vi.frames);
+	endSection(w, len);
+
+	len = beginSection(w, tagScheduler);
+	put64(w, sched->cycles);
+	for (uint64_t d : sched->deadline) {
+		put64(w, d);
+	}
+	endSection(w, len);
+
+	len = beginSection(w, tagPIF);
+	putBytes(w, pif->ram, sizeof(pif->ram));
+	put32(w, pif->siDramAddr);
+	put32(w, pif->siStatus);
+	put8(w, pif->eepromType);
+	putBytes(w, pif->eeprom, eepromBytes(pif->eepromType));
+	uint8_t paks = 0;
+	for (int i = 0; i < 4; i++) {
+		paks |= pif->pakInserted[i] << i;
+	}
+	put8(w, paks);
+	for (int i = 0; i < 4; i++) {
+		if (pif->pakInserted[i]) {
+			putPacked(w, pif->pak[i], sizeof(pif->pak[i]));
+		}
+	}
+	endSection(w, len);
+
+	if (!withRDRAM) {
+		return w.ok ? w.p - buf : 0;
+	}
+
+	len = beginSection(w, tagRDRAM);
+	put32(w, mem->expansionPak);
+	put32(w, mem->size);
+	uint8_t *packedSize = w.p;
+	put32(w, 0);
+	if (w.ok) {
+		/* Saved in guest byte order; RDRAM itself is only read */
+		swap32(mem->guestOrder, mem->mem, mem->size);
+		size_t packed = lzCompress(mem->guestOrder, mem->size, w.p,
+					   w.end - w.p);
+		if (!packed) {
+			return 0;
+		}
+		uint32_t packed32 = (uint32_t)packed;
+		memcpy(packedSize, &packed32, sizeof(packed32));
+		w.p += packed;
+	}
+	endSection(w, len);
+
+	return w.ok ? w.p - buf : 0;
+}
+
+/* A section located by the first pass of loadState(). */
+struct Section {
+	const uint8_t *data;
+	uint32_t length;
+};
+
+/* Walk the PIF section, checking it fits; applies it if pif is non-null. */
+static bool
+getPIF(Section s, PIF *out)
+{
+	Reader r = { s.data, s.data + s.length };
+	const size_t fixed = pifFixedSize - 1;
+
+	if (s.length < pifFixedSize) {
+		return false;
+	}
+	if (out) {
+		getBytes(r, out->ram, sizeof(out->ram));
+		out->siDramAddr = get32(r);
+		out->siStatus = get32(r);
+	} else {
+		r.p += fixed - 1;
+	}
+	uint8_t type = get8(r);
+	if (type > EEPROM16K) {
+		return false;
+	}
+	size_t eepromSize = eepromBytes((EEPROMType)type);
+	if ((size_t)(r.end - r.p) < eepromSize + 1) {
+		return false;
+	}
+	if (out) {
+		out->eepromType = (EEPROMType)type;
+		getBytes(r, out->eeprom, eepromSize);
+	} else {
+		r.p += eepromSize;
+	}
+
+	uint8_t paks = get8(r);
+	for (int i = 0; i < 4; i++) {
+		bool inserted = paks & (1 << i);
+		if (out) {
+			out->pakInserted[i] = inserted;
+		}
+		if (!inserted) {
+			continue;
+		}
+		if (r.end - r.p < 4) {
+			return false;
+		}
+		uint32_t packed = get32(r);
+		if ((size_t)(r.end - r.p) < packed) {
+			return false;
+		}
+		if (out && !lzDecompress(r.p, packed, out->pak[i],
+					 sizeof(out->pak[i]))) {
+			return false;
+		}
+		r.p += packed;
+	}
+	return r.p == r.end;
+}
+
+bool
+loadState(const uint8_t *buf, size_t size)
+{
+	Reader r = { buf, buf + size };
+	Section cpu = {}, rsp = {}, spmem = {}, mis = {}, vis = {},
+		scheds = {}, pifs = {}, rdram = {};
+
+	if (size < headerSize) {
+		return false;
+	}
+	if (get32(r) != saveStateMagic || get32(r) != saveStateVersion) {
+		return false;
+	}
+
+	/* First pass: check the layout without modifying any state. */
+	while (r.p != r.end) {
+		if ((size_t)(r.end - r.p) < sectionHeaderSize) {
+			return false;
+		}
+		uint32_t tag = get32(r);
+		uint32_t length = get32(r);
+		Section s = { r.p, length };
+		if ((size_t)(r.end - r.p) < s.length) {
+			return false;
+		}
+		r.p += s.length;
+
+		if (tag == tagCPU) {
+			cpu = s;
+		} else if (tag == tagRSP) {
+			rsp = s;
+		} else if (tag == tagSP) {
+			spmem = s;
+		} else if (tag == tagMI) {
+			mis = s;
+		} else if (tag == tagVI) {
+			vis = s;
+		} else if (tag == tagScheduler) {
+			scheds = s;
+		} else if (tag == tagPIF) {
+			pifs = s;
+		} else if (tag == tagRDRAM) {
+			rdram = s;
+		}
+	}
+	if (cpu.length != registersSize || rsp.length != registersSize ||
+	    spmem.length != sizeof(*sp) || mis.length != miSize ||
+	    vis.length != viSize ||
+	    scheds.length != schedulerSize ||
+	    !getPIF(pifs, nullptr)) {
+		return false;
+	}
+	if (rdram.data) {
+		if (rdram.length < rdramHeaderSize) {
+			return false;
+		}
+		Reader h = { rdram.data, rdram.data + rdram.length };
+		bool expansionPak = get32(h) != 0;
+		uint32_t unpacked = get32(h);
+		uint32_t packed = get32(h);
+		if (unpacked != (expansionPak ? rdramSize : rdramBaseSize) ||
+		    packed != rdram.length - rdramHeaderSize) {
+			return false;
+		}
+	}
+
+	/* Second pass: restore in place. */
+	r = { cpu.data, cpu.data + cpu.length };
+	getRegisters(r, *reg);
+	fpuSyncHost();
+	r = { rsp.data, rsp.data + rsp.length };
+	getRegisters(r, *rcp);
+	r = { spmem.data, spmem.data + spmem.length };
+	getBytes(r, sp->dmem, sizeof(sp->dmem));
+	getBytes(r, sp->imem, sizeof(sp->imem));
+	r = { mis.data, mis.data + mis.length };
+	mi->mode = get32(r);
+	mi->intr = get32(r);
+	mi->mask = get32(r);
+	r = { vis.data, vis.data + vis.length };
+	for (uint32_t &v : emu->vi.regs) {
+		v = get32(r);
+	}
+	emu->vi.lastSync = get64(r);
+	emu->vi.frames = get64(r);
+	r = { scheds.data, scheds.data + scheds.length };
+	sched->cycles = get64(r);
+	for (uint64_t &d : sched->deadline) {
+		d = get64(r);
+	}
+	rescheduleAll();
+	if (!getPIF(pifs, pif)) {
+		return false;
+	}
+
+	if (!rdram.data) {
+		return true;
+	}
+	markAllDirty();
+	r = { rdram.data, rdram.data + rdram.length };
+	rdramSetExpansionPak(get32(r) != 0);
+	get32(r);
+	uint32_t packed = get32(r);
+	bool ok = lzDecompress(r.p, packed, mem->mem, mem->size);
+	swap32(mem->mem, mem->mem, mem->size);
+	return ok;
+}
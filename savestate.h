@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Save states are a little-endian binary snapshot: a header (magic,
+ * version) followed by tagged sections of the form { tag, length, data }.
+ * Unknown sections are skipped on load so older readers can cope with
+ * newer files of the same version. RDRAM is LZ compressed (see lz.h)
+ * and only as large as the installed memory; everything else is small
+ * and stored raw.
+ *
+ * Both directions work on caller-owned buffers and restore in place, so
+ * taking and loading snapshots in a loop never touches the allocator.
+ */
+
+static const uint32_t saveStateMagic = 0x5334364e; /* "N64S" */
+static const uint32_t saveStateVersion = 8;
+
+/* Upper bound on the size of a snapshot of the current machine. */
+extern size_t
+saveStateBound(bool withRDRAM = true);
+
+/*
+ * Write a snapshot into buf. Returns its size, or 0 if capacity is less
+ * than needed. Sizing buf with saveStateBound() never fails. Without
+ * RDRAM the snapshot holds only the (small) register state, which is
+ * what the rewind buffer stores alongside its own page deltas.
+ */
+extern size_t
+saveState(uint8_t *buf, size_t capacity, bool withRDRAM = true);
+
+/*
+ * Restore a snapshot taken with saveState(). The header and section
+ * layout are validated before anything is touched; a corrupt RDRAM
+ * payload is only detected while decoding, in which case false is
+ * returned and RDRAM contents are unspecified. A snapshot without RDRAM
+ * leaves it untouched; otherwise every page is marked dirty.
+ */
+extern bool
+loadState(const uint8_t *buf, size_t size);
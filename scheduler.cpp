@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "cpu.h"
+#include "scheduler.h"
+#include "vi.h"
+
+static void
+yield()
+{
+}
+
+static void (*const handlers[EventTypes])() = {
+	compareReached,
+	cpuInterrupt,
+	viSync,
+	yield,
+};
+
+void
+rescheduleAll()
+{
+	sched->next = never;
+	for (uint64_t d : sched->deadline) {
+		if (d < sched->next) {
+			sched->next = d;
+		}
+	}
+}
+
+void
+schedulerReset()
+{
+	sched->cycles = 0;
+	for (uint64_t &d : sched->deadline) {
+		d = never;
+	}
+	sched->next = never;
+}
+
+void
+schedule(EventType event, uint64_t cycle)
+{
+	sched->deadline[event] = cycle;
+	rescheduleAll();
+}
+
+void
+cancel(EventType event)
+{
+	schedule(event, never);
+}
+
+void
+runEvents()
+{
+	while (sched->next <= sched->cycles) {
+		for (int i = 0; i < EventTypes; i++) {
+			if (sched->deadline[i] <= sched->cycles) {
+				sched->deadline[i] = never;
+				handlers[i]();
+			}
+		}
+		rescheduleAll();
+	}
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+/*
+ * Timed work is kept off the instruction loop: instead of polling every
+ * device after every instruction, each source registers the cycle at
+ * which it next needs attention and the CPU runs uninterrupted until the
+ * earliest of them. Time is counted in VR4300 pipeline cycles.
+ */
+
+enum EventType {
+	EventCompare, /* COUNT reaches COMPARE */
+	EventInterrupt, /* An enabled CPU interrupt became pending */
+	EventVI,      /* Vertical sync */
+	EventYield,   /* End of the current runCPU() slice */
+	EventTypes,
+};
+
+static const uint64_t never = UINT64_MAX;
+
+struct Scheduler {
+	uint64_t cycles;
+	uint64_t next;
+	uint64_t deadline[EventTypes];
+};
+
+extern thread_local Scheduler *sched;
+
+/* Start from cycle zero with nothing scheduled. */
+extern void
+schedulerReset();
+
+/* Fire event at the given absolute cycle, replacing any earlier request. */
+extern void
+schedule(EventType event, uint64_t cycle);
+
+extern void
+cancel(EventType event);
+
+/* Run the handlers of every event that is due. */
+extern void
+runEvents();
+
+/* Recompute sched->next after deadlines were changed directly. */
+extern void
+rescheduleAll();
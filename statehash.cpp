@@ -0,0 +1,254 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstdio>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "cpu.h"
+#include "mem.h"
+#include "rcp.h"
+#include "emulator.h"
+#include "statehash.h"
+
+static const uint64_t prime1 = 0x9e3779b185ebca87ull;
+static const uint64_t prime2 = 0xc2b2ae3d27d4eb4full;
+
+/* Per-lane keys, the first 64 bytes of the XXH3 default secret. */
+alignas(64) static const uint64_t secret[8] = {
+	0xbe4ba423396cfeb8ull, 0x1cad21f72c81017cull, 0xdb979083e96dd4deull,
+	0x1f67b3b7a4a44072ull, 0x78e5c0cc4ee679cbull, 0x2172ffcc7dd05a82ull,
+	0x8e2443f7744608b8ull, 0x4c263a81e69035e0ull,
+};
+
+
+/*
+ * One 64-byte stripe: each lane adds the product of the low and high
+ * halves of (data ^ key), and the neighbouring lane adds the raw data.
+ */
+static inline void
+accumulateScalar(uint64_t *acc, const uint8_t *p)
+{
+	for (int i = 0; i < 8; i++) {
+		uint64_t data;
+		memcpy(&data, p + 8 * i, sizeof(data));
+		uint64_t key = data ^ secret[i];
+		acc[i ^ 1] += data;
+		acc[i] += (key & 0xffffffff) * (key >> 32);
+	}
+}
+
+static inline uint64_t
+avalanche(uint64_t h)
+{
+	h ^= h >> 37;
+	h *= 0x165667919e3779f9ull;
+	return h ^ (h >> 32);
+}
+
+static uint64_t
+finish(const uint64_t *acc, size_t size)
+{
+	uint64_t h = size * prime1;
+	for (int i = 0; i < 8; i++) {
+		h = (h ^ avalanche(acc[i] ^ secret[i])) * prime2;
+	}
+	return avalanche(h);
+}
+
+typedef void (*Accumulator)(uint64_t *acc, const uint8_t *p,
+			   const uint8_t *end);
+
+#if defined(__SSE2__)
+static void
+accumulateSSE2(uint64_t *acc, const uint8_t *p, const uint8_t *end)
+{
+	__m128i a[4], k[4];
+	for (int i = 0; i < 4; i++) {
+		a[i] = _mm_load_si128((const __m128i *)acc + i);
+		k[i] = _mm_load_si128((const __m128i *)secret + i);
+	}
+	for (; p < end; p += 64) {
+		for (int i = 0; i < 4; i++) {
+			__m128i d = _mm_loadu_si128((const __m128i *)p + i);
+			__m128i x = _mm_xor_si128(d, k[i]);
+			a[i] = _mm_add_epi64(a[i], _mm_shuffle_epi32(d, 0x4e));
+			a[i] = _mm_add_epi64(
+				a[i], _mm_mul_epu32(x, _mm_srli_epi64(x, 32)));
+		}
+	}
+	for (int i = 0; i < 4; i++) {
+		_mm_store_si128((__m128i *)acc + i, a[i]);
+	}
+}
+
+__attribute__((target("avx2"))) static void
+accumulateAVX2(uint64_t *acc, const uint8_t *p, const uint8_t *end)
+{
+	__m256i a0 = _mm256_load_si256((const __m256i *)acc);
+	__m256i a1 = _mm256_load_si256((const __m256i *)acc + 1);
+	const __m256i k0 = _mm256_load_si256((const __m256i *)secret);
+	const __m256i k1 = _mm256_load_si256((const __m256i *)secret + 1);
+	for (; p < end; p += 64) {
+		__m256i d0 = _mm256_loadu_si256((const __m256i *)p);
+		__m256i d1 = _mm256_loadu_si256((const __m256i *)p + 1);
+		__m256i x0 = _mm256_xor_si256(d0, k0);
+		__m256i x1 = _mm256_xor_si256(d1, k1);
+		a0 = _mm256_add_epi64(a0, _mm256_shuffle_epi32(d0, 0x4e));
+		a1 = _mm256_add_epi64(a1, _mm256_shuffle_epi32(d1, 0x4e));
+		a0 = _mm256_add_epi64(
+			a0, _mm256_mul_epu32(x0, _mm256_srli_epi64(x0, 32)));
+		a1 = _mm256_add_epi64(
+			a1, _mm256_mul_epu32(x1, _mm256_srli_epi64(x1, 32)));
+	}
+	_mm256_store_si256((__m256i *)acc, a0);
+	_mm256_store_si256((__m256i *)acc + 1, a1);
+}
+#else
+static void
+accumulateStripes(uint64_t *acc, const uint8_t *p, const uint8_t *end)
+{
+	for (; p < end; p += 64) {
+		accumulateScalar(acc, p);
+	}
+}
+#endif
+
+/* The widest accumulator the host CPU runs, picked once at startup. */
+static Accumulator
+pickAccumulator()
+{
+#if defined(__SSE2__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		return accumulateAVX2;
+	}
+	return accumulateSSE2;
+#else
+	return accumulateStripes;
+#endif
+}
+
+static const Accumulator accumulate = pickAccumulator();
+
+uint64_t
+hashBlock(const void *data, size_t size)
+{
+	const uint8_t *p = (const uint8_t *)data;
+	alignas(32) uint64_t acc[8] = { prime1, prime2, prime1, prime2,
+					prime2, prime1, prime2, prime1 };
+
+	accumulate(acc, p, p + size);
+	return finish(acc, size);
+}
+
+static void
+packRegisters(const Registers &r, uint64_t *out)
+{
+	out[0] = r.pc;
+	out[1] = r.hi;
+	out[2] = r.lo;
+	memcpy(&out[3], r.gpr, sizeof(r.gpr));
+	memcpy(&out[35], r.fpr, sizeof(r.fpr));
+	memcpy(&out[67], r.cop0, sizeof(r.cop0));
+	out[99] = r.fcr31;
+	out[100] = r.llbit;
+	out[101] = r.nextPC;
+	out[102] = r.delaySlot;
+}
+
+uint64_t
+stateHash()
+{
+	StateHash &s = emu->hash;
+	uint32_t pages = mem->size >> rdramPageShift;
+
+	if (!s.pageHashValid) {
+		for (uint32_t i = 0; i < pages; i++) {
+			s.pageHash[i] = hashBlock(&mem->mem[i * rdramPageSize],
+						rdramPageSize);
+		}
+		clearDirty(DirtyHash);
+		s.pageHashValid = true;
+	} else {
+		uint16_t dirtyPages[rdramPages];
+		uint32_t count = collectDirty(DirtyHash, dirtyPages);
+		for (uint32_t i = 0; i < count; i++) {
+			uint32_t page = dirtyPages[i];
+			s.pageHash[page] = hashBlock(
+				&mem->mem[page * rdramPageSize], rdramPageSize);
+		}
+	}
+
+	/* Two register files, padded to whole stripes. */
+	uint64_t regs[2][104] = {};
+	packRegisters(*reg, regs[0]);
+	packRegisters(*rcp, regs[1]);
+
+	uint64_t parts[4] = {
+		hashBlock(s.pageHash, pages * sizeof(s.pageHash[0])),
+		hashBlock(regs, sizeof(regs)),
+		hashBlock(sp->dmem, sizeof(sp->dmem)),
+		hashBlock(sp->imem, sizeof(sp->imem)),
+	};
+	uint64_t h = 0;
+	for (uint64_t part : parts) {
+		h = avalanche((h ^ part) * prime1);
+	}
+	return h;
+}
+
+bool
+stateHashLogOpen(const char *path)
+{
+	StateHash &s = emu->hash;
+
+	if (s.hashLog) {
+		fclose(s.hashLog);
+		s.hashLog = nullptr;
+	}
+	if (path) {
+		s.hashLog = fopen(path, "w");
+		s.frame = 0;
+		return s.hashLog != nullptr;
+	}
+	return true;
+}
+
+void
+stateHashFrame()
+{
+	StateHash &s = emu->hash;
+
+	if (!s.hashLog) {
+		return;
+	}
+	fprintf(s.hashLog, "%llu %016llx\n", (unsigned long long)s.frame++,
+		(unsigned long long)stateHash());
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+#include "mem.h"
+
+/*
+ * Per-frame digest of the machine state, for comparing runs between
+ * builds and bisecting a divergence down to the frame it starts on.
+ *
+ * RDRAM is hashed a page at a time and the page hashes are cached, so
+ * only pages dirtied since the previous call are rehashed. Registers and
+ * RSP DMEM/IMEM are small and hashed in full. The block hash is an
+ * XXH3-style 64-byte stripe accumulator with SSE2 and AVX2 paths, the
+ * widest the host supports picked at startup. All paths produce
+ * identical results, so digests from different hosts and builds are
+ * comparable.
+ */
+
+struct StateHash {
+	uint64_t pageHash[rdramPages];
+	bool pageHashValid;
+	FILE *hashLog;
+	uint64_t frame;
+};
+
+/* Hash size bytes (a multiple of 64) with the stripe accumulator. */
+extern uint64_t
+hashBlock(const void *data, size_t size);
+
+/* Digest of the whole machine state. */
+extern uint64_t
+stateHash();
+
+/*
+ * Log "<frame> <digest>" for every frame to path, or stop logging if
+ * path is null. Returns false if the file cannot be opened.
+ */
+extern bool
+stateHashLogOpen(const char *path);
+
+/* Called at every VI sync; a no-op unless logging is enabled. */
+extern void
+stateHashFrame();
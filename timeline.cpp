@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+#include "arena.h"
+#include "timeline.h"
+
+/* Reserved per thread; only what is recorded gets committed */
+static const size_t logBytes = 256 << 20;
+
+struct TimelineEvent {
+	const char *name;
+	uint64_t start;
+	uint64_t duration;
+	bool wait;
+};
+
+struct ThreadLog {
+	Arena arena;
+	TimelineEvent *events;
+	size_t count;
+	size_t capacity;
+	uint64_t dropped;
+	uint32_t tid;
+	const char *name;
+};
+
+static std::atomic<bool> enabled;
+static std::chrono::steady_clock::time_point epoch;
+
+static std::mutex registry;
+static std::vector<ThreadLog *> logs;
+static thread_local ThreadLog *threadLog;
+static thread_local const char *threadName;
+
+static inline uint64_t
+now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		       std::chrono::steady_clock::now() - epoch)
+		.count();
+}
+
+/*
+ * The calling thread's log, created on first use while recording. The
+ * arena is reserved, not committed (see arena.h), so threads that record
+ * little cost little.
+ */
+static ThreadLog *
+currentLog()
+{
+	if (threadLog) {
+		return threadLog;
+	}
+
+	ThreadLog *log = new ThreadLog();
+	if (arenaCreate(log->arena, logBytes)) {
+		log->capacity = log->arena.size / sizeof(TimelineEvent);
+		log->events = (TimelineEvent *)arenaAlloc(
+			log->arena, log->capacity * sizeof(TimelineEvent),
+			alignof(TimelineEvent));
+	}
+
+	log->name = threadName;
+
+	std::lock_guard<std::mutex> guard(registry);
+	log->tid = (uint32_t)logs.size() + 1;
+	logs.push_back(log);
+	threadLog = log;
+	return log;
+}
+
+TimelineScope::TimelineScope(const char *n, bool w)
+	: name(n), start(0), wait(w)
+{
+	if (enabled.load(std::memory_order_relaxed)) {
+		/* Zero means "not recording", so never start at it */
+		start = now() | 1;
+	}
+}
+
+TimelineScope::~TimelineScope()
+{
+	if (!start || !enabled.load(std::memory_order_relaxed)) {
+		return;
+	}
+
+	ThreadLog *log = currentLog();
+	if (log->count == log->capacity) {
+		log->dropped++;
+		return;
+	}
+	log->events[log->count++] = { name, start, now() - start, wait };
+}
+
+void
+timelineStart()
+{
+	epoch = std::chrono::steady_clock::now();
+	enabled = true;
+}
+
+void
+timelineThreadName(const char *name)
+{
+	threadName = name;
+	if (enabled.load(std::memory_order_relaxed)) {
+		currentLog()->name = name;
+	}
+}
+
+bool
+timelineWrite(const char *path)
+{
+	enabled = false;
+
+	FILE *file = fopen(path, "w");
+	if (!file) {
+		return false;
+	}
+
+	std::lock_guard<std::mutex> guard(registry);
+	fprintf(file, "{\"traceEvents\":[\n");
+	bool first = true;
+	for (const ThreadLog *log : logs) {
+		if (log->name) {
+			fprintf(file,
+				"%s{\"name\":\"thread_name\",\"ph\":\"M\","
+				"\"pid\":1,\"tid\":%u,"
+				"\"args\":{\"name\":\"%s\"}}",
+				first ? "" : ",\n", log->tid, log->name);
+			first = false;
+		}
+		for (size_t i = 0; i < log->count; i++) {
+			const TimelineEvent &e = log->events[i];
+			/* Microseconds, as the format expects */
+			fprintf(file,
+				"%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\","
+				"\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+				first ? "" : ",\n", e.name,
+				e.wait ? "wait" : "span", log->tid,
+				e.start / 1e3, e.duration / 1e3);
+			first = false;
+		}
+		if (log->dropped) {
+			fprintf(stderr, "timeline: %s dropped %llu events\n",
+				log->name ? log->name : "thread",
+				(unsigned long long)log->dropped);
+		}
+	}
+	fprintf(file, "\n]}\n");
+	return fclose(file) == 0;
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+/*
+ * Cross-thread timeline in the Chrome trace-event format, which
+ * chrome://tracing and Perfetto open directly. TIMELINE_SPAN("name")
+ * records the rest of the enclosing block as a span on the calling
+ * thread; TIMELINE_WAIT("name") does the same for time spent blocked on
+ * another thread, so stalls stand out.
+ *
+ * Events go into a per-thread log carved from its own arena and are only
+ * formatted when timelineWrite() runs at shutdown. While the timeline is
+ * off a scope costs one relaxed load.
+ */
+
+struct TimelineScope {
+	const char *name;
+	uint64_t start;
+	bool wait;
+
+	TimelineScope(const char *n, bool w);
+	~TimelineScope();
+};
+
+#define TIMELINE_CONCAT(a, b) a##b
+#define TIMELINE_NAME(line) TIMELINE_CONCAT(timelineScope, line)
+#define TIMELINE_SPAN(name) TimelineScope TIMELINE_NAME(__LINE__)(name, false)
+#define TIMELINE_WAIT(name) TimelineScope TIMELINE_NAME(__LINE__)(name, true)
+
+/* Start recording on every thread. */
+extern void
+timelineStart();
+
+/*
+ * Label the calling thread in the output. name must outlive the run.
+ * Costs nothing until the thread records while the timeline is on.
+ */
+extern void
+timelineThreadName(const char *name);
+
+/*
+ * Stop recording and write every thread's events to path. The other
+ * threads must be done recording. Returns false on I/O failure.
+ */
+extern bool
+timelineWrite(const char *path);
@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "timers.h"
+
+#ifdef N64_TIMERS
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+
+#include "gui/imgui.h"
+
+static const int historyFrames = 240;
+
+static const char *const names[Timers] = {
+	"CPU", "RSP", "VI", "DMA",
+};
+
+static const ImU32 colors[Timers] = {
+	IM_COL32(230, 85, 70, 255),
+	IM_COL32(240, 170, 50, 255),
+	IM_COL32(70, 170, 230, 255),
+	IM_COL32(200, 200, 200, 255),
+};
+
+/* The current frame, in nanoseconds */
+static std::atomic<uint64_t> counters[Timers];
+
+/*
+ * Closed frames, written by the thread calling timersFrame() and read by
+ * whichever draws the overlay or the report
+ */
+static std::mutex historyLock;
+static uint64_t history[historyFrames][Timers];
+static int historyNext;
+static uint64_t totals[Timers];
+static uint64_t frames;
+
+/* The innermost running scope of this thread, and when it resumed */
+static thread_local bool active;
+static thread_local TimerSubsystem current;
+static thread_local std::chrono::steady_clock::time_point resumed;
+
+/* Charge the running scope up to now and restart its clock. */
+static inline void
+charge(std::chrono::steady_clock::time_point now)
+{
+	if (active) {
+		std::chrono::nanoseconds ns = now - resumed;
+		counters[current].fetch_add(ns.count(),
+					    std::memory_order_relaxed);
+	}
+	resumed = now;
+}
+
+ScopedTimer::ScopedTimer(TimerSubsystem s)
+{
+	charge(std::chrono::steady_clock::now());
+	subsystem = s;
+	parent = current;
+	nested = active;
+	active = true;
+	current = s;
+}
+
+ScopedTimer::~ScopedTimer()
+{
+	charge(std::chrono::steady_clock::now());
+	active = nested;
+	current = parent;
+}
+
+void
+timersFrame()
+{
+	uint64_t frame[Timers];
+
+	for (int i = 0; i < Timers; i++) {
+		frame[i] = counters[i].exchange(0, std::memory_order_relaxed);
+	}
+
+	std::lock_guard<std::mutex> lock(historyLock);
+	for (int i = 0; i < Timers; i++) {
+		history[historyNext][i] = frame[i];
+		totals[i] += frame[i];
+	}
+	historyNext = (historyNext + 1) % historyFrames;
+	frames++;
+}
+
+void
+timersReport(FILE *out)
+{
+	std::lock_guard<std::mutex> lock(historyLock);
+	uint64_t total = 0;
+
+	for (uint64_t t : totals) {
+		total += t;
+	}
+	fprintf(out, "%-8s %12s %12s %7s\n", "", "total ms", "ms/frame",
+		"share");
+	for (int i = 0; i < Timers; i++) {
+		fprintf(out, "%-8s %12.3f %12.3f %6.1f%%\n", names[i],
+			totals[i] / 1e6, frames ? totals[i] / 1e6 / frames : 0,
+			total ? 100.0 * totals[i] / total : 0);
+	}
+}
+
+void
+timersWindow(bool *open)
+{
+	if (!ImGui::Begin("Frame time", open)) {
+		ImGui::End();
+		return;
+	}
+
+	/* Oldest first */
+	static uint64_t shown[historyFrames][Timers];
+	{
+		std::lock_guard<std::mutex> lock(historyLock);
+		size_t older = historyFrames - historyNext;
+		memcpy(shown, history[historyNext], older * sizeof(shown[0]));
+		memcpy(shown[older], history, historyNext * sizeof(shown[0]));
+	}
+
+	/* Scale the graph to the slowest frame shown */
+	uint64_t peak = 1;
+	for (const uint64_t *frame : shown) {
+		uint64_t sum = 0;
+		for (int i = 0; i < Timers; i++) {
+			sum += frame[i];
+		}
+		peak = sum > peak ? sum : peak;
+	}
+	ImGui::Text("Peak %.2f ms", peak / 1e6);
+
+	ImVec2 origin = ImGui::GetCursorScreenPos();
+	ImVec2 size(ImGui::GetContentRegionAvail().x, 120);
+	ImDrawList *draw = ImGui::GetWindowDrawList();
+	float barWidth = size.x / historyFrames;
+
+	draw->AddRectFilled(origin, ImVec2(origin.x + size.x, origin.y + size.y),
+			    IM_COL32(20, 20, 20, 255));
+	for (int f = 0; f < historyFrames; f++) {
+		const uint64_t *frame = shown[f];
+		float x = origin.x + f * barWidth;
+		float y = origin.y + size.y;
+		for (int i = 0; i < Timers; i++) {
+			float h = size.y * frame[i] / peak;
+			draw->AddRectFilled(ImVec2(x, y - h),
+					    ImVec2(x + barWidth, y), colors[i]);
+			y -= h;
+		}
+	}
+	ImGui::Dummy(size);
+
+	const uint64_t *last = shown[historyFrames - 1];
+	for (int i = 0; i < Timers; i++) {
+		ImGui::ColorButton(names[i], ImColor(colors[i]),
+				   ImGuiColorEditFlags_NoTooltip,
+				   ImVec2(10, 10));
+		ImGui::SameLine();
+		ImGui::Text("%-4s %8.3f ms", names[i], last[i] / 1e6);
+	}
+	ImGui::End();
+}
+
+#endif
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+/*
+ * Host time spent per emulated subsystem, for finding out where a frame
+ * goes. TIMER_SCOPE(TimerX) charges the rest of the enclosing block to
+ * subsystem X. Scopes nest exclusively: while an inner scope runs its
+ * outer one is paused, so the subsystems add up to the instrumented
+ * total. Counters are process-wide and lock-free; timersFrame() closes
+ * a frame and keeps a short history for the overlay, which may be drawn
+ * from another thread.
+ *
+ * All of it compiles to nothing unless N64_TIMERS is defined (the
+ * N64_TIMERS CMake option).
+ */
+
+enum TimerSubsystem {
+	TimerCPU,
+	TimerRSP,
+	TimerVI,
+	TimerDMA,
+	Timers,
+};
+
+#ifdef N64_TIMERS
+
+struct ScopedTimer {
+	TimerSubsystem subsystem;
+	TimerSubsystem parent;
+	bool nested;
+
+	ScopedTimer(TimerSubsystem s);
+	~ScopedTimer();
+};
+
+#define TIMER_CONCAT(a, b) a##b
+#define TIMER_NAME(line) TIMER_CONCAT(scopedTimer, line)
+#define TIMER_SCOPE(subsystem) ScopedTimer TIMER_NAME(__LINE__)(subsystem)
+
+/* End the current frame, moving its counters into the history. */
+extern void
+timersFrame();
+
+/* Totals and per-frame averages since startup. */
+extern void
+timersReport(FILE *out);
+
+/* Stacked frame-time graph of recent frames. */
+extern void
+timersWindow(bool *open);
+
+#else
+
+#define TIMER_SCOPE(subsystem) \
+	do {                   \
+	} while (0)
+
+static inline void
+timersFrame()
+{
+}
+
+static inline void
+timersReport(FILE *)
+{
+}
+
+static inline void
+timersWindow(bool *)
+{
+}
+
+#endif
@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+#include "disasm.h"
+#include "emulator.h"
+#include "timeline.h"
+#include "trace.h"
+
+/* Must be a power of two */
+static const size_t ringSize = 4 << 20;
+static const size_t headerSize = 10;
+static const size_t maxRecordSize = headerSize + traceRegisters * 9;
+
+struct TraceRing {
+	uint8_t buf[ringSize];
+	/* Total bytes ever produced and consumed; only ever grow. */
+	std::atomic<size_t> head;
+	std::atomic<size_t> tail;
+	std::atomic<bool> stop;
+	FILE *file;
+	std::thread writer;
+	/* Register values as of the previous record of each core */
+	uint64_t shadow[TraceCores][traceRegisters];
+};
+
+static void
+drain(TraceRing *t)
+{
+	timelineThreadName("trace writer");
+
+	for (;;) {
+		size_t tail = t->tail.load(std::memory_order_relaxed);
+		size_t head = t->head.load(std::memory_order_acquire);
+
+		if (head == tail) {
+			if (t->stop.load(std::memory_order_acquire) &&
+			    t->head.load(std::memory_order_acquire) == tail) {
+				return;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+		size_t start = tail & (ringSize - 1);
+		size_t size = head - tail;
+		if (size > ringSize - start) {
+			size = ringSize - start;
+		}
+		TIMELINE_SPAN("trace flush");
+		fwrite(&t->buf[start], 1, size, t->file);
+		t->tail.store(tail + size, std::memory_order_release);
+	}
+}
+
+bool
+traceOpen(const char *path)
+{
+	traceClose();
+
+	FILE *file = fopen(path, "wb");
+	if (!file) {
+		return false;
+	}
+	uint32_t header[2] = { traceMagic, traceVersion };
+	fwrite(header, sizeof(header), 1, file);
+
+	TraceRing *t = new TraceRing();
+	t->file = file;
+	t->writer = std::thread(drain, t);
+	emu->trace.ring = t;
+	return true;
+}
+
+void
+traceClose()
+{
+	TraceRing *t = emu->trace.ring;
+
+	if (!t) {
+		return;
+	}
+	emu->trace.ring = nullptr;
+	t->stop.store(true, std::memory_order_release);
+	t->writer.join();
+	fclose(t->file);
+	delete t;
+}
+
+void
+traceInstruction(TraceCore core, uint64_t pc, uint32_t opcode,
+		 const Registers &r)
+{
+	TraceRing *t = emu->trace.ring;
+	uint8_t rec[maxRecordSize];
+	uint8_t *p = rec + headerSize;
+	uint8_t deltas = 0;
+
+	if (!t) {
+		return;
+	}
+
+	uint64_t *shadow = t->shadow[core];
+	for (int i = 0; i < traceRegisters; i++) {
+		uint64_t v = i < 32 ? r.gpr[i] : i == traceHI ? r.hi : r.lo;
+		if (v != shadow[i]) {
+			shadow[i] = v;
+			*p++ = (uint8_t)i;
+			memcpy(p, &v, sizeof(v));
+			p += sizeof(v);
+			deltas++;
+		}
+	}
+	rec[0] = core;
+	rec[1] = deltas;
+	uint32_t pc32 = (uint32_t)pc;
+	memcpy(&rec[2], &pc32, sizeof(pc32));
+	memcpy(&rec[6], &opcode, sizeof(opcode));
+
+	size_t size = p - rec;
+	size_t head = t->head.load(std::memory_order_relaxed);
+	if (head + size - t->tail.load(std::memory_order_acquire) > ringSize) {
+		TIMELINE_WAIT("trace ring full");
+		while (head + size - t->tail.load(std::memory_order_acquire) >
+		       ringSize) {
+			std::this_thread::yield();
+		}
+	}
+	size_t start = head & (ringSize - 1);
+	size_t first = size < ringSize - start ? size : ringSize - start;
+	memcpy(&t->buf[start], rec, first);
+	memcpy(&t->buf[0], rec + first, size - first);
+	t->head.store(head + size, std::memory_order_release);
+}
+
+bool
+traceDump(const char *path)
+{
+	FILE *file = fopen(path, "rb");
+	uint32_t header[2];
+
+	if (!file) {
+		return false;
+	}
+	if (fread(header, sizeof(header), 1, file) != 1 ||
+	    header[0] != traceMagic || header[1] != traceVersion) {
+		fclose(file);
+		return false;
+	}
+
+	uint8_t rec[maxRecordSize];
+	while (fread(rec, headerSize, 1, file) == 1) {
+		uint8_t core = rec[0];
+		uint8_t deltas = rec[1];
+		uint32_t pc, opcode;
+		memcpy(&pc, &rec[2], sizeof(pc));
+		memcpy(&opcode, &rec[6], sizeof(opcode));
+		if (core >= TraceCores || deltas > traceRegisters ||
+		    fread(rec, 9, deltas, file) != deltas) {
+			fclose(file);
+			return false;
+		}
+
+		/* Addresses are sign-extended from 32 bits */
+		std::cout << (core == TraceRSP ? "rsp " : "cpu ") << std::hex
+			  << std::setfill('0') << std::setw(16)
+			  << (uint64_t)(int64_t)(int32_t)pc << ' '
+			  << std::setw(8) << opcode << ' ';
+		char text[disasmMaxLength];
+		if (core == TraceVR4300) {
+			disassembleVR4300(opcode, (int64_t)(int32_t)pc, text,
+					  sizeof(text));
+		} else {
+			disassembleRSP(opcode, pc, text, sizeof(text));
+		}
+		std::cout << text;
+		for (int i = 0; i < deltas; i++) {
+			uint8_t n = rec[i * 9];
+			uint64_t v;
+			memcpy(&v, &rec[i * 9 + 1], sizeof(v));
+			if (n == traceHI) {
+				std::cout << " hi=";
+			} else if (n == traceLO) {
+				std::cout << " lo=";
+			} else {
+				std::cout << " r" << std::dec << (int)n << '='
+					  << std::hex;
+			}
+			std::cout << std::setw(16) << v;
+		}
+		std::cout << std::dec << std::setfill(' ') << '\n';
+	}
+
+	fclose(file);
+	return true;
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "cpu.h"
+
+/*
+ * Binary execution traces, recorded by the run loops compiled with the
+ * trace policy and decoded offline with --trace-dump. The other run
+ * loops contain no trace code at all.
+ *
+ * A trace file is a u32 magic and u32 version followed by one record per
+ * instruction, little-endian:
+ *
+ *   u8 core, u8 delta count, u32 pc, u32 opcode,
+ *   then per delta: u8 register, u64 value
+ *
+ * where pc is the low half of the sign-extended address and a delta is
+ * a GPR (0-31), HI (32) or LO (33) that differs from the previous
+ * record of the same core.
+ *
+ * Each instance records into its own ring buffer, which a writer thread
+ * drains to disk. The ring is single producer, single consumer and
+ * lock-free; whichever thread runs the instance only waits if the disk
+ * falls behind.
+ */
+
+static const uint32_t traceMagic = 0x5434364e; /* "N64T" */
+static const uint32_t traceVersion = 1;
+
+enum TraceCore : uint8_t {
+	TraceVR4300,
+	TraceRSP,
+	TraceCores,
+};
+
+static const int traceHI = 32;
+static const int traceLO = 33;
+static const int traceRegisters = 34;
+
+struct TraceRing;
+
+struct TraceState {
+	TraceRing *ring = nullptr;
+};
+
+/*
+ * Start recording instructions run by the bound instance to path, on
+ * whatever thread later runs it. Returns false if the file cannot be
+ * created.
+ */
+extern bool
+traceOpen(const char *path);
+
+/* Flush what is buffered and close the bound instance's trace. */
+extern void
+traceClose();
+
+/* Record one executed instruction; a no-op if no trace is open. */
+extern void
+traceInstruction(TraceCore core, uint64_t pc, uint32_t opcode,
+		 const Registers &r);
+
+/* Print a trace file as text. Returns false if it cannot be read. */
+extern bool
+traceDump(const char *path);
@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstring>
+
+#include "emulator.h"
+#include "frameskip.h"
+#include "mailbox.h"
+#include "mem.h"
+#include "mi.h"
+#include "scheduler.h"
+#include "statehash.h"
+#include "timers.h"
+#include "vi.h"
+
+void
+viReset()
+{
+	VIState &v = emu->vi;
+
+	memset(v.regs, 0, sizeof(v.regs));
+	v.lastSync = sched->cycles;
+	v.frames = 0;
+	schedule(EventVI, v.lastSync + viFrameCycles);
+}
+
+/* The half-line being scanned, from how far into the field we are. */
+static uint32_t
+currentLine()
+{
+	VIState &v = emu->vi;
+	uint64_t lines = v.regs[VIVSync] & 0x3ff;
+
+	if (!lines) {
+		lines = 525;
+	}
+	return (uint32_t)((sched->cycles - v.lastSync) * lines / viFrameCycles);
+}
+
+uint32_t
+viRead(uint32_t offset)
+{
+	uint32_t i = offset >> 2;
+
+	if (i == VICurrent) {
+		return currentLine();
+	}
+	return i < VIRegisters ? emu->vi.regs[i] : 0;
+}
+
+void
+viWrite(uint32_t offset, uint32_t value)
+{
+	uint32_t i = offset >> 2;
+
+	if (i == VICurrent) {
+		/* Any write acknowledges the interrupt */
+		miClear(MIInterruptVI);
+	} else if (i < VIRegisters) {
+		emu->vi.regs[i] = value;
+	}
+}
+
+static inline uint32_t
+expand5(uint32_t v)
+{
+	return v << 3 | v >> 2;
+}
+
+/* Convert the current framebuffer to RGBA8. */
+static void
+scanOut(Frame &f)
+{
+	const uint32_t *regs = emu->vi.regs;
+	uint32_t type = regs[VIStatus] & 3;
+	uint32_t stride = regs[VIWidth] & 0xfff;
+
+	f.width = 0;
+	f.height = 0;
+	if (type < 2 || !stride) {
+		/* Blanked */
+		return;
+	}
+
+	uint32_t vStart = regs[VIVStart];
+	uint32_t lines = ((vStart & 0x3ff) - (vStart >> 16 & 0x3ff)) / 2;
+	uint32_t height = lines * (regs[VIYScale] & 0xfff) >> 10;
+	uint32_t width = stride < frameMaxWidth ? stride : frameMaxWidth;
+	if (!height || height > frameMaxHeight) {
+		height = width * 3 / 4;
+	}
+	f.width = width;
+	f.height = height;
+
+	uint32_t origin = regs[VIOrigin] & 0xffffff;
+	uint32_t *out = f.pixels;
+	for (uint32_t y = 0; y < height; y++) {
+		uint32_t line = origin + y * stride * (type == 3 ? 4 : 2);
+		for (uint32_t x = 0; x < width; x++) {
+			if (type == 3) {
+				uint32_t p = rdramRead32(line + 4 * x);
+				*out++ = __builtin_bswap32(p) | 0xff000000;
+			} else {
+				uint32_t p = rdramRead16(line + 2 * x);
+				*out++ = expand5(p >> 11) |
+					 expand5(p >> 6 & 31) << 8 |
+					 expand5(p >> 1 & 31) << 16 | 0xff000000;
+			}
+		}
+	}
+}
+
+void
+viSync()
+{
+	TIMER_SCOPE(TimerVI);
+	VIState &v = emu->vi;
+
+	v.lastSync += viFrameCycles;
+	v.frames++;
+	schedule(EventVI, v.lastSync + viFrameCycles);
+
+	if (v.mailbox && !emu->frameskip.skipping &&
+	    (!v.skipUntaken || mailboxTaken(*v.mailbox))) {
+		scanOut(*mailboxBack(*v.mailbox));
+		mailboxPublish(*v.mailbox);
+	}
+	frameskipFrame();
+	stateHashFrame();
+	miRaise(MIInterruptVI);
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2020 Justin Warner
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+struct FrameMailbox;
+
+/*
+ * Video interface, enough to pace frames and show a framebuffer: the
+ * registers, a vertical sync every viFrameCycles and a scan-out of the
+ * framebuffer described by ORIGIN, WIDTH, V_START and Y_SCALE. The VI
+ * interrupt is raised at vertical sync rather than on line V_INTR, and
+ * there is no filtering or interlacing. Frames dropped by frame skipping
+ * (see frameskip.h) are not scanned out.
+ */
+
+/* Register indices, in address order from 0x04400000. */
+enum VIRegister {
+	VIStatus,
+	VIOrigin,
+	VIWidth,
+	VIIntr,
+	VICurrent,
+	VIBurst,
+	VIVSync,
+	VIHSync,
+	VILeap,
+	VIHStart,
+	VIVStart,
+	VIVBurst,
+	VIXScale,
+	VIYScale,
+	VIRegisters,
+};
+
+/* NTSC, 60 fields a second. */
+static const uint64_t viFrameCycles = 93750000 / 60;
+
+struct VIState {
+	uint32_t regs[VIRegisters];
+	/* Cycle of the last vertical sync, and syncs since reset */
+	uint64_t lastSync;
+	uint64_t frames;
+	/* Where scanned out frames go; with none, nothing is scanned out */
+	FrameMailbox *mailbox;
+	/* Only scan out frames the consumer will see (fast-forward) */
+	bool skipUntaken;
+};
+
+/* Clear the registers and schedule the first vertical sync. */
+extern void
+viReset();
+
+/* Register access at an offset into the VI register block. */
+extern uint32_t
+viRead(uint32_t offset);
+
+extern void
+viWrite(uint32_t offset, uint32_t value);
+
+/* EventVI handler. */
+extern void
+viSync();